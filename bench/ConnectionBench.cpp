@@ -0,0 +1,126 @@
+// Measures request latency of a running task server while it holds many idle connections.
+// Opens <idle> keep-alive connections that each make one request and then sit
+// idle (reconnecting whenever the server drops them, as the UI would), and
+// meanwhile runs <clients> threads issuing GET requests back to back. Start
+// the server with --mode=threads or --mode=epoll and compare the output.
+// Linux only; raise the open file limit (ulimit -n) above <idle> first.
+//
+// usage: connection_bench [idle=10000] [clients=32] [seconds=10] [path=/tasks/1] [port=8080]
+
+// This process holds more descriptors than select() can watch
+#define CPPHTTPLIB_USE_POLL
+#include "httplib.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+// Function to open a connection and send one request on it; returns -1 on failure
+static int openIdleConnection(int port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    static const char request[] = "GET /tasks/0 HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+        || ::send(fd, request, sizeof(request) - 1, MSG_NOSIGNAL) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char* argv[]) {
+    size_t idleCount = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000;
+    int clients = argc > 2 ? std::atoi(argv[2]) : 32;
+    int seconds = argc > 3 ? std::atoi(argv[3]) : 10;
+    std::string path = argc > 4 ? argv[4] : "/tasks/1";
+    int port = argc > 5 ? std::atoi(argv[5]) : 8080;
+
+    // Open the idle connections before measuring
+    std::vector<pollfd> idle;
+    for (size_t i = 0; i < idleCount; ++i) {
+        int fd = openIdleConnection(port);
+        if (fd < 0) {
+            std::fprintf(stderr, "Could only open %zu idle connections\n", i);
+            break;
+        }
+        idle.push_back({ fd, POLLIN, 0 });
+    }
+
+    std::atomic<bool> stop{ false };
+    std::atomic<uint64_t> reconnects{ 0 };
+    // Drain responses and replace connections the server closed, so the count stays up
+    std::thread keeper([&] {
+        char buffer[4096];
+        while (!stop) {
+            if (::poll(idle.data(), idle.size(), 100) <= 0) continue;
+            for (auto& p : idle) {
+                if (!p.revents) continue;
+                if (::recv(p.fd, buffer, sizeof(buffer), MSG_DONTWAIT) <= 0) {
+                    ::close(p.fd);
+                    p.fd = openIdleConnection(port);
+                    ++reconnects;
+                }
+            }
+        }
+    });
+
+    std::mutex latenciesMutex;
+    std::vector<double> latencies;
+    std::atomic<uint64_t> failed{ 0 };
+    std::vector<std::thread> threads;
+    for (int i = 0; i < clients; ++i) {
+        threads.emplace_back([&] {
+            httplib::Client cli("127.0.0.1", port);
+            cli.set_keep_alive(true);
+            cli.set_tcp_nodelay(true);
+            cli.set_connection_timeout(5);
+            cli.set_read_timeout(5);
+            std::vector<double> mine;
+            while (!stop) {
+                auto start = Clock::now();
+                auto res = cli.Get(path);
+                double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+                if (res) mine.push_back(ms);
+                else ++failed;
+            }
+            std::lock_guard<std::mutex> lock(latenciesMutex);
+            latencies.insert(latencies.end(), mine.begin(), mine.end());
+        });
+    }
+    auto start = Clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop = true;
+    for (auto& thread : threads) thread.join();
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    keeper.join();
+    for (auto& p : idle) {
+        if (p.fd >= 0) ::close(p.fd);
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        return latencies.empty() ? 0.0 : latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))];
+    };
+    std::printf("idle connections  %zu (%llu reconnects)\n", idle.size(), static_cast<unsigned long long>(reconnects.load()));
+    std::printf("requests          %zu ok, %llu failed, %.0f req/s\n", latencies.size(),
+        static_cast<unsigned long long>(failed.load()), latencies.size() / elapsed);
+    std::printf("latency ms        p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n",
+        percentile(0.50), percentile(0.90), percentile(0.99), latencies.empty() ? 0.0 : latencies.back());
+    return 0;
+}
@@ -0,0 +1,72 @@
+// Compares requests/sec of httplib's default ThreadPool with WorkStealingQueue.
+// An in-process server answers a tiny GET while client threads hammer it,
+// once opening a new connection per request (one executor job each, which
+// is where the queue is hit hardest) and once over keep-alive connections.
+
+#include "WorkStealingQueue.h"
+#include "httplib.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const int PORT = 18080;
+
+// Function to run the clients against a server using the given executor; returns requests/sec
+static double measure(const std::function<httplib::TaskQueue*()>& newQueue, int clients, int seconds, bool keepAlive) {
+    httplib::Server server;
+    server.new_task_queue = newQueue;
+    // Without it Nagle's algorithm and delayed ACKs cap keep-alive runs at ~25 requests/sec per connection
+    server.set_tcp_nodelay(true);
+    server.Get("/ping", [](const httplib::Request&, httplib::Response& res) {
+        res.set_content("pong", "text/plain");
+    });
+    std::thread listener([&] { server.listen("127.0.0.1", PORT); });
+    server.wait_until_ready();
+
+    std::atomic<bool> stop{ false };
+    std::atomic<uint64_t> done{ 0 };
+    std::atomic<uint64_t> failed{ 0 };
+    std::vector<std::thread> threads;
+    for (int i = 0; i < clients; ++i) {
+        threads.emplace_back([&] {
+            httplib::Client cli("127.0.0.1", PORT);
+            cli.set_keep_alive(keepAlive);
+            cli.set_tcp_nodelay(true);
+            while (!stop) {
+                auto res = cli.Get("/ping");
+                if (res && res->status == 200) ++done;
+                else ++failed;
+            }
+        });
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop = true;
+    for (auto& thread : threads) thread.join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    server.stop();
+    listener.join();
+    if (failed) std::fprintf(stderr, "  (%llu failed requests)\n", static_cast<unsigned long long>(failed.load()));
+    return done / elapsed;
+}
+
+int main(int argc, char* argv[]) {
+    int seconds = argc > 1 ? std::atoi(argv[1]) : 3;
+    size_t workers = CPPHTTPLIB_THREAD_POOL_COUNT;
+    std::printf("%zu workers, %d s per run\n", workers, seconds);
+    std::printf("%-10s %8s %14s %14s\n", "mode", "clients", "pool req/s", "stealing req/s");
+    for (bool keepAlive : { false, true }) {
+        for (int clients : { 1, 4, 16, 64 }) {
+            double pool = measure([workers] { return new httplib::ThreadPool(workers); }, clients, seconds, keepAlive);
+            double stealing = measure([workers] { return new WorkStealingQueue(workers); }, clients, seconds, keepAlive);
+            std::printf("%-10s %8d %14.0f %14.0f\n", keepAlive ? "keepalive" : "connect", clients, pool, stealing);
+        }
+    }
+    return 0;
+}
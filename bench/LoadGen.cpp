@@ -0,0 +1,333 @@
+// HTTP load generator for the task server.
+// Drives a mix of GET/POST/PUT/DELETE /tasks requests over N keep-alive
+// connections, one thread each, and reports throughput and latency
+// percentiles per operation.
+//
+// Closed loop (default): each connection sends its next request as soon as
+// the previous one is answered, which finds the highest sustainable rate.
+// Its raw latencies hide stalls, though: while the server is stuck the
+// client sends nothing, so a 1 s pause shows up as one slow request
+// instead of the many that would have queued behind it (coordinated
+// omission). The report therefore also shows them corrected the way
+// HdrHistogram does, assuming requests were due every mean latency.
+//
+// Open loop (--rate=R): requests are due at a fixed total rate of R per
+// second spread evenly over the connections, whether or not earlier ones
+// have been answered, and latency is measured from when a request was due
+// rather than when it could be sent. A stall then counts against every
+// request it delayed, so no correction is needed; the time from actually
+// sending is shown too as service time.
+//
+// GET, PUT and DELETE use tasks the generator creates first with
+// POST /tasks/batch (--seed of them, split between the connections);
+// deletes remove them, so long delete-heavy runs need a larger seed.
+//
+// usage: load_gen [--host=127.0.0.1] [--port=8080] [--connections=16] [--seconds=10]
+//                 [--warmup-s=1] [--rate=0] [--mix=get:70,post:10,put:15,delete:5]
+//                 [--seed=10000] [--expected-interval-us=0]
+
+#include "Metrics.h"
+#include "httplib.h"
+#include "json.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+enum Op { OP_GET, OP_POST, OP_PUT, OP_DELETE, OP_COUNT };
+static const char* const OP_NAMES[OP_COUNT] = { "get", "post", "put", "delete" };
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    size_t connections = 16;
+    double seconds = 10;
+    double warmupSeconds = 1;
+    // Requests per second over all connections, 0 runs closed loop
+    double rate = 0;
+    std::array<unsigned, OP_COUNT> mix{ { 70, 10, 15, 5 } };
+    size_t seed = 10000;
+    // Interval assumed by the closed-loop correction, 0 uses the mean latency
+    uint64_t expectedIntervalNs = 0;
+};
+
+// What one connection measured after the warmup
+struct Result {
+    std::array<LatencyHistogram, OP_COUNT> latency;
+    // Closed loop: same as latency; open loop: measured from the actual send
+    std::array<LatencyHistogram, OP_COUNT> service;
+    std::array<uint64_t, OP_COUNT> errors{};
+    // Deletes of tasks already gone because the connection ran out of seeded ones
+    uint64_t missing = 0;
+    // Open loop: requests due before the end that were never sent because the connection fell behind
+    uint64_t unsent = 0;
+};
+
+// Function to read get:70,post:10,... into per-operation weights
+static std::array<unsigned, OP_COUNT> parseMix(const std::string& text) {
+    std::array<unsigned, OP_COUNT> mix{};
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find(',', start);
+        if (end == std::string::npos) end = text.size();
+        std::string item = text.substr(start, end - start);
+        size_t colon = item.find(':');
+        std::string name = item.substr(0, colon);
+        auto op = std::find(std::begin(OP_NAMES), std::end(OP_NAMES), name);
+        if (colon == std::string::npos || op == std::end(OP_NAMES)) throw std::invalid_argument("Bad --mix entry: " + item);
+        mix[op - std::begin(OP_NAMES)] = static_cast<unsigned>(std::stoul(item.substr(colon + 1)));
+        start = end + 1;
+    }
+    return mix;
+}
+
+static Options parseOptions(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto eq = arg.find('=');
+        if (arg.rfind("--", 0) != 0 || eq == std::string::npos) throw std::invalid_argument("Expected --name=value, got: " + arg);
+        std::string name = arg.substr(2, eq - 2);
+        std::string value = arg.substr(eq + 1);
+        if (name == "host") options.host = value;
+        else if (name == "port") options.port = std::stoi(value);
+        else if (name == "connections") options.connections = std::stoull(value);
+        else if (name == "seconds") options.seconds = std::stod(value);
+        else if (name == "warmup-s") options.warmupSeconds = std::stod(value);
+        else if (name == "rate") options.rate = std::stod(value);
+        else if (name == "mix") options.mix = parseMix(value);
+        else if (name == "seed") options.seed = std::stoull(value);
+        else if (name == "expected-interval-us") options.expectedIntervalNs = std::stoull(value) * 1000;
+        else throw std::invalid_argument("Unknown option: --" + name);
+    }
+    if (options.connections == 0) throw std::invalid_argument("--connections must be at least 1");
+    unsigned total = 0;
+    for (unsigned weight : options.mix) total += weight;
+    if (total == 0) throw std::invalid_argument("--mix needs at least one non-zero weight");
+    return options;
+}
+
+// Function to create the tasks the run works on; returns their IDs
+static std::vector<int> seedTasks(const Options& options) {
+    httplib::Client cli(options.host, options.port);
+    std::vector<int> ids;
+    const size_t BATCH = 1000;
+    for (size_t done = 0; done < options.seed; done += BATCH) {
+        nlohmann::json operations = nlohmann::json::array();
+        for (size_t i = done; i < std::min(options.seed, done + BATCH); ++i) {
+            operations.push_back({ { "op", "create" }, { "description", "load test task " + std::to_string(i) } });
+        }
+        auto res = cli.Post("/tasks/batch", operations.dump(), "application/json");
+        if (!res || res->status != 200) throw std::runtime_error("Could not seed tasks through POST /tasks/batch");
+        nlohmann::json response = nlohmann::json::parse(res->body);
+        for (const auto& result : response["results"]) {
+            if (result.value("status", 0) == 200) ids.push_back(result.value("id", 0));
+        }
+    }
+    return ids;
+}
+
+// Function to send one request; returns false on a transport error or a 5xx/unexpected 4xx
+static bool issue(httplib::Client& cli, Op op, std::vector<int>& ids, std::mt19937& rng, uint64_t& missing) {
+    auto randomId = [&] {
+        return ids.empty() ? 1 : ids[std::uniform_int_distribution<size_t>(0, ids.size() - 1)(rng)];
+    };
+    httplib::Result res;
+    switch (op) {
+    case OP_GET:
+        res = cli.Get("/tasks/" + std::to_string(randomId()));
+        break;
+    case OP_POST:
+        res = cli.Post("/tasks", R"({"description":"load test task"})", "application/json");
+        break;
+    case OP_PUT:
+        res = cli.Put("/tasks/" + std::to_string(randomId()),
+            R"({"description":"updated by load test )" + std::to_string(rng() % 1000) + "\"}", "application/json");
+        break;
+    default: {
+        if (ids.empty()) {
+            ++missing;
+            res = cli.Delete("/tasks/1");
+            return res && res->status < 500;
+        }
+        size_t index = std::uniform_int_distribution<size_t>(0, ids.size() - 1)(rng);
+        int id = ids[index];
+        ids[index] = ids.back();
+        ids.pop_back();
+        res = cli.Delete("/tasks/" + std::to_string(id));
+        break;
+    }
+    }
+    return res && res->status < 400;
+}
+
+// Function run by each connection's thread until the end of the run
+static void runConnection(const Options& options, size_t index, std::vector<int> ids,
+    Clock::time_point start, Clock::time_point measureFrom, Clock::time_point end, Result& result) {
+    httplib::Client cli(options.host, options.port);
+    cli.set_keep_alive(true);
+    cli.set_tcp_nodelay(true);
+    cli.set_connection_timeout(10);
+    cli.set_read_timeout(10);
+    std::mt19937 rng(static_cast<unsigned>(index + 1));
+    std::discrete_distribution<int> pickOp(options.mix.begin(), options.mix.end());
+
+    // Open loop: this connection's share of the rate, its first slot offset so connections don't fire together
+    bool openLoop = options.rate > 0;
+    Clock::duration interval = openLoop
+        ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.connections / options.rate))
+        : Clock::duration::zero();
+    Clock::time_point next = start + interval * index / options.connections;
+
+    for (;;) {
+        Clock::time_point due;
+        if (openLoop) {
+            due = next;
+            next += interval;
+            if (due >= end) break;
+            if (Clock::now() >= end) {
+                // Out of time with requests still due: the server could not keep up with the rate
+                result.unsent += (end - due) / interval + 1;
+                break;
+            }
+            // Already late: send at once, the delay still counts because latency is taken from due
+            std::this_thread::sleep_until(due);
+        }
+        else {
+            due = Clock::now();
+            if (due >= end) break;
+        }
+        Op op = static_cast<Op>(pickOp(rng));
+        Clock::time_point sent = Clock::now();
+        bool ok = issue(cli, op, ids, rng, result.missing);
+        Clock::time_point done = Clock::now();
+        if (due < measureFrom) continue;
+        if (!ok) ++result.errors[op];
+        result.latency[op].record(std::chrono::duration_cast<std::chrono::nanoseconds>(done - due).count());
+        result.service[op].record(std::chrono::duration_cast<std::chrono::nanoseconds>(done - sent).count());
+    }
+}
+
+// Function to add the samples a stalled closed-loop client never sent, as
+// HdrHistogram's copyCorrectedForCoordinatedOmission does: a request that
+// took L when one was due every I stands in for the ones that would have
+// waited L - I, L - 2I, ... down to I behind it
+static LatencyHistogram correctForCoordinatedOmission(const LatencyHistogram& histogram, uint64_t interval) {
+    LatencyHistogram corrected = histogram;
+    if (interval == 0) return corrected;
+    for (size_t bucket = 0; bucket < LatencyHistogram::BUCKETS; ++bucket) {
+        uint64_t count = histogram.counts[bucket];
+        if (count == 0) continue;
+        for (uint64_t missed = LatencyHistogram::lowerBound(bucket); missed > interval; ) {
+            missed -= interval;
+            if (missed < interval) break;
+            corrected.counts[LatencyHistogram::bucketOf(missed)] += count;
+            corrected.count += count;
+            corrected.sum += missed * count;
+        }
+    }
+    return corrected;
+}
+
+static void printHeader() {
+    std::printf("%-8s %10s %8s %9s %9s %9s %9s %9s\n", "op", "count", "errors", "p50 ms", "p90 ms", "p99 ms", "p99.9 ms", "max ms");
+}
+
+static void printRow(const char* name, const LatencyHistogram& histogram, uint64_t errors) {
+    auto ms = [&](double q) { return histogram.quantile(q) / 1e6; };
+    std::printf("%-8s %10llu %8llu %9.3f %9.3f %9.3f %9.3f %9.3f\n", name, static_cast<unsigned long long>(histogram.count),
+        static_cast<unsigned long long>(errors), ms(0.5), ms(0.9), ms(0.99), ms(0.999), ms(1.0));
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    std::vector<int> ids;
+    try {
+        options = parseOptions(argc, argv);
+        ids = seedTasks(options);
+    }
+    catch (const std::exception& e) {
+        std::fprintf(stderr, "Error: %s\n", e.what());
+        return 1;
+    }
+
+    // Deal the seeded tasks out so connections never delete each other's
+    std::vector<std::vector<int>> slices(options.connections);
+    for (size_t i = 0; i < ids.size(); ++i) slices[i % options.connections].push_back(ids[i]);
+
+    std::vector<Result> results(options.connections);
+    std::vector<std::thread> threads;
+    Clock::time_point start = Clock::now();
+    Clock::time_point measureFrom = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.warmupSeconds));
+    Clock::time_point end = measureFrom + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.seconds));
+    for (size_t i = 0; i < options.connections; ++i) {
+        threads.emplace_back(runConnection, std::cref(options), i, std::move(slices[i]), start, measureFrom, end, std::ref(results[i]));
+    }
+    for (auto& thread : threads) thread.join();
+
+    Result total;
+    for (const Result& result : results) {
+        for (size_t op = 0; op < OP_COUNT; ++op) {
+            total.latency[op].merge(result.latency[op]);
+            total.service[op].merge(result.service[op]);
+            total.errors[op] += result.errors[op];
+        }
+        total.missing += result.missing;
+        total.unsent += result.unsent;
+    }
+    LatencyHistogram all, allService;
+    uint64_t allErrors = 0;
+    for (size_t op = 0; op < OP_COUNT; ++op) {
+        all.merge(total.latency[op]);
+        allService.merge(total.service[op]);
+        allErrors += total.errors[op];
+    }
+
+    bool openLoop = options.rate > 0;
+    if (openLoop) {
+        std::printf("open loop at %.0f req/s, %zu connections, %.0f s after %.0f s warmup\n",
+            options.rate, options.connections, options.seconds, options.warmupSeconds);
+    }
+    else {
+        std::printf("closed loop, %zu connections, %.0f s after %.0f s warmup\n", options.connections, options.seconds, options.warmupSeconds);
+    }
+    std::printf("throughput %.0f req/s (%llu requests, %llu errors)\n", all.count / options.seconds,
+        static_cast<unsigned long long>(all.count), static_cast<unsigned long long>(allErrors));
+    if (total.unsent) {
+        std::printf("%llu requests were due but never sent, the server could not keep up with --rate\n",
+            static_cast<unsigned long long>(total.unsent));
+    }
+    if (total.missing) {
+        std::printf("%llu deletes found no task left to delete, raise --seed\n", static_cast<unsigned long long>(total.missing));
+    }
+
+    std::printf("\nlatency%s\n", openLoop ? " from when each request was due" : " (uncorrected)");
+    printHeader();
+    for (size_t op = 0; op < OP_COUNT; ++op) {
+        if (total.latency[op].count) printRow(OP_NAMES[op], total.latency[op], total.errors[op]);
+    }
+    printRow("all", all, allErrors);
+
+    if (openLoop) {
+        std::printf("\nservice time from the actual send\n");
+        printHeader();
+        printRow("all", allService, allErrors);
+    }
+    else {
+        uint64_t interval = options.expectedIntervalNs ? options.expectedIntervalNs : (all.count ? all.sum / all.count : 0);
+        std::printf("\nlatency corrected for coordinated omission, a request due every %.3f ms per connection\n", interval / 1e6);
+        printHeader();
+        for (size_t op = 0; op < OP_COUNT; ++op) {
+            if (total.latency[op].count) printRow(OP_NAMES[op], correctForCoordinatedOmission(total.latency[op], interval), total.errors[op]);
+        }
+        printRow("all", correctForCoordinatedOmission(all, interval), allErrors);
+    }
+    return 0;
+}
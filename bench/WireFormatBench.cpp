@@ -0,0 +1,64 @@
+// Compares JSON, MessagePack and CBOR for the GET /tasks document:
+// payload size, time to encode it on the server and time for the client to
+// decode it and rebuild its task map, across several task counts. Decoding
+// is timed both through a json DOM and through the SAX reader the client uses.
+#include "Task.h"
+#include "WireFormat.h"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+
+using json = nlohmann::json;
+
+// Function to build a {"<id>": task} document like the one GET /tasks returns
+static json makeTasks(int count) {
+    json jTasks = json::object();
+    for (int id = 1; id <= count; ++id) {
+        jTasks[std::to_string(id)] = Task{ id, "Task number " + std::to_string(id) + " with a typical description" }.to_json();
+    }
+    return jTasks;
+}
+
+// Function to time fn over enough runs to be stable, returns microseconds per run
+template <typename Fn>
+static double timeIt(Fn&& fn) {
+    int runs = 0;
+    auto start = std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::micro> elapsed{};
+    do {
+        fn();
+        ++runs;
+        elapsed = std::chrono::steady_clock::now() - start;
+    } while (elapsed.count() < 200000 && runs < 1000);
+    return elapsed.count() / runs;
+}
+
+int main() {
+    const WireFormat formats[] = { WireFormat::Json, WireFormat::MsgPack, WireFormat::Cbor };
+    std::printf("%8s  %-20s %10s %11s %11s %11s\n", "tasks", "format", "bytes", "encode us", "dom us", "sax us");
+    for (int count : { 100, 1000, 10000, 100000 }) {
+        json jTasks = makeTasks(count);
+        for (WireFormat format : formats) {
+            std::string payload;
+            double encodeUs = timeIt([&] { payload = encodeWire(jTasks, format); });
+            // Decoding includes filling the map, as loadTasksFromServer() does
+            double domUs = timeIt([&] {
+                std::unordered_map<int, Task> tasks;
+                json jDecoded = decodeWire(payload, format);
+                for (const auto& [id, taskJson] : jDecoded.items()) {
+                    tasks[std::stoi(id)] = Task::from_json(taskJson);
+                }
+            });
+            double saxUs = timeIt([&] {
+                std::unordered_map<int, Task> tasks;
+                for (auto& task : readTaskDocument(payload, format).tasks) {
+                    tasks[task.id] = std::move(task);
+                }
+            });
+            std::printf("%8d  %-20s %10zu %11.0f %11.0f %11.0f\n", count, wireFormatContentType(format), payload.size(),
+                encodeUs, domUs, saxUs);
+        }
+    }
+    return 0;
+}
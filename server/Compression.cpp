@@ -0,0 +1,84 @@
+﻿#include "Compression.h"
+#include <cctype>
+#include <cstdlib>
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+#include <zlib.h>
+#endif
+
+// Function to read the q-value of one Accept-Encoding entry ("gzip;q=0.5"), 1 if absent
+static double qualityOf(const std::string& parameters) {
+    size_t q = parameters.find("q=");
+    return q == std::string::npos ? 1.0 : std::atof(parameters.c_str() + q + 2);
+}
+
+ContentCoding negotiateContentCoding(const std::string& acceptEncoding) {
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+    double gzip = -1;
+    double deflate = -1;
+    double any = -1;
+    size_t pos = 0;
+    while (pos <= acceptEncoding.size()) {
+        size_t end = acceptEncoding.find(',', pos);
+        if (end == std::string::npos) end = acceptEncoding.size();
+        std::string entry = acceptEncoding.substr(pos, end - pos);
+        pos = end + 1;
+
+        size_t semicolon = entry.find(';');
+        std::string name = entry.substr(0, semicolon);
+        size_t first = name.find_first_not_of(" \t");
+        size_t last = name.find_last_not_of(" \t");
+        if (first == std::string::npos) continue;
+        name = name.substr(first, last - first + 1);
+        for (char& c : name) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        double quality = semicolon == std::string::npos ? 1.0 : qualityOf(entry.substr(semicolon));
+
+        if (name == "gzip" || name == "x-gzip") gzip = quality;
+        else if (name == "deflate") deflate = quality;
+        else if (name == "*") any = quality;
+    }
+    // Codings not listed by name fall back to the wildcard, if there is one
+    if (gzip < 0) gzip = any;
+    if (deflate < 0) deflate = any;
+    if (gzip > 0 && gzip >= deflate) return ContentCoding::Gzip;
+    if (deflate > 0) return ContentCoding::Deflate;
+#else
+    (void)acceptEncoding;
+#endif
+    return ContentCoding::Identity;
+}
+
+const char* contentCodingName(ContentCoding coding) {
+    switch (coding) {
+    case ContentCoding::Gzip: return "gzip";
+    case ContentCoding::Deflate: return "deflate";
+    default: return "";
+    }
+}
+
+// Function to compress a whole body in one pass
+bool compressBody(std::string_view data, ContentCoding coding, std::string& out) {
+    out.clear();
+    if (coding == ContentCoding::Identity) {
+        out.assign(data);
+        return true;
+    }
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+    z_stream stream{};
+    // 16 + 15 window bits asks zlib for a gzip wrapper, plain 15 for the zlib one HTTP calls deflate
+    int windowBits = coding == ContentCoding::Gzip ? 16 + MAX_WBITS : MAX_WBITS;
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    out.resize(deflateBound(&stream, static_cast<uLong>(data.size())) + 32);
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    stream.avail_out = static_cast<uInt>(out.size());
+    int result = deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result == Z_STREAM_END;
+#else
+    return false;
+#endif
+}
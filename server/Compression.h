@@ -0,0 +1,25 @@
+﻿#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <string>
+#include <string_view>
+
+// Content codings the server can send, see RFC 9110 section 8.4.1
+enum class ContentCoding {
+    Identity,
+    Gzip,
+    Deflate
+};
+
+// Picks the coding to send for an Accept-Encoding header, honouring q-values
+// and preferring gzip over deflate. Always Identity when the server was
+// built without CPPHTTPLIB_ZLIB_SUPPORT.
+ContentCoding negotiateContentCoding(const std::string& acceptEncoding);
+
+// Value of the Content-Encoding header for a coding, empty for Identity
+const char* contentCodingName(ContentCoding coding);
+
+// Compresses data with a coding, returns false if zlib fails
+bool compressBody(std::string_view data, ContentCoding coding, std::string& out);
+
+#endif // COMPRESSION_H
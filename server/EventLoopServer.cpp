@@ -0,0 +1,495 @@
+﻿#include "EventLoopServer.h"
+
+#ifdef __linux__
+
+#ifndef CPPHTTPLIB_USE_POLL
+#error "EventLoopServer needs CPPHTTPLIB_USE_POLL: httplib's select() checks fail on descriptors above FD_SETSIZE"
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Bytes read ahead of the worker before a connection stops being read
+static const size_t MAX_BUFFERED_INPUT = 1024 * 1024;
+// Bytes a worker may queue for sending before it waits for the loop to drain them
+static const size_t MAX_BUFFERED_OUTPUT = 1024 * 1024;
+// Connections accepted per wakeup, so one loop cannot grab a whole burst
+static const int ACCEPT_BATCH = 64;
+// How often each loop looks for connections idle past the keep-alive timeout
+static const std::chrono::seconds IDLE_SWEEP_INTERVAL(1);
+
+using Clock = std::chrono::steady_clock;
+
+// State of one client connection, shared by its loop and the worker handling it
+struct EventLoopServer::Connection {
+    int fd;
+    Loop* loop;
+    std::string remoteIp;
+    int remotePort = 0;
+    std::string localIp;
+    int localPort = 0;
+
+    std::mutex mutex;
+    // Signalled when input arrives, output drains or the connection fails
+    std::condition_variable changed;
+    // Received bytes the worker has not taken yet
+    std::string in;
+    // Bytes waiting to be sent, from outPos on
+    std::string out;
+    size_t outPos = 0;
+    // A worker is handling a request
+    bool busy = false;
+    // The client finished sending (read returned 0)
+    bool peerClosed = false;
+    // A socket error happened or the server is shutting down
+    bool failed = false;
+    // Close once the response is sent (Connection: close, keep-alive limit, bad request)
+    bool closeWhenDone = false;
+    // Reading stopped because in is full
+    bool readPaused = false;
+    size_t served = 0;
+    Clock::time_point lastActive = Clock::now();
+
+    // Marks the connection busy if a complete request header is buffered; mutex must be held
+    bool startRequest() {
+        if (busy || failed || closeWhenDone || in.find("\r\n\r\n") == std::string::npos) return false;
+        busy = true;
+        return true;
+    }
+};
+
+struct EventLoopServer::Loop {
+    int epollFd = -1;
+    // eventfd that workers write to after post()
+    int wakeFd = -1;
+    std::thread thread;
+    // Only touched by the loop thread
+    std::unordered_map<int, std::shared_ptr<Connection>> connections;
+    std::mutex postedMutex;
+    std::vector<std::shared_ptr<Connection>> posted;
+};
+
+// httplib::Stream over a connection's buffers, used by the worker handling a request.
+// Reads take whatever the loop has received, waiting for more if needed.
+// Writes go straight to the socket while it accepts them; the rest is left
+// for the loop to send when the socket becomes writable again.
+class EventLoopServer::ConnectionStream : public httplib::Stream {
+public:
+    ConnectionStream(EventLoopServer& server, std::shared_ptr<Connection> connection,
+        std::chrono::microseconds readTimeout, std::chrono::microseconds writeTimeout)
+        : server_(server), connection_(std::move(connection)), readTimeout_(readTimeout), writeTimeout_(writeTimeout) {}
+
+    bool is_readable() const override {
+        if (pos_ < pending_.size()) return true;
+        std::lock_guard<std::mutex> lock(connection_->mutex);
+        return !connection_->in.empty();
+    }
+
+    bool is_writable() const override {
+        std::lock_guard<std::mutex> lock(connection_->mutex);
+        return !connection_->failed && !connection_->peerClosed;
+    }
+
+    ssize_t read(char* ptr, size_t size) override {
+        if (pos_ == pending_.size()) {
+            Connection& connection = *connection_;
+            std::unique_lock<std::mutex> lock(connection.mutex);
+            connection.changed.wait_for(lock, readTimeout_, [&] {
+                return !connection.in.empty() || connection.peerClosed || connection.failed;
+            });
+            if (connection.in.empty()) return connection.peerClosed && !connection.failed ? 0 : -1;
+            // Take everything received so far, httplib reads headers a byte at a time
+            pending_.clear();
+            pending_.swap(connection.in);
+            pos_ = 0;
+            if (connection.readPaused) {
+                lock.unlock();
+                server_.post(connection_);
+            }
+        }
+        size_t n = std::min(size, pending_.size() - pos_);
+        std::memcpy(ptr, pending_.data() + pos_, n);
+        pos_ += n;
+        return static_cast<ssize_t>(n);
+    }
+
+    ssize_t write(const char* ptr, size_t size) override {
+        Connection& connection = *connection_;
+        std::unique_lock<std::mutex> lock(connection.mutex);
+        if (connection.failed) return -1;
+        size_t sent = 0;
+        if (connection.outPos == connection.out.size()) {
+            connection.out.clear();
+            connection.outPos = 0;
+            while (sent < size) {
+                ssize_t n = ::send(connection.fd, ptr + sent, size - sent, MSG_NOSIGNAL);
+                if (n > 0) sent += static_cast<size_t>(n);
+                else if (n < 0 && errno == EINTR) continue;
+                else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+                else {
+                    connection.failed = true;
+                    return -1;
+                }
+            }
+        }
+        // The socket is full; the loop sends the rest once it reports EPOLLOUT
+        connection.out.append(ptr + sent, size - sent);
+        bool drained = connection.changed.wait_for(lock, writeTimeout_, [&] {
+            return connection.out.size() - connection.outPos <= MAX_BUFFERED_OUTPUT || connection.failed;
+        });
+        if (!drained || connection.failed) {
+            connection.failed = true;
+            return -1;
+        }
+        return static_cast<ssize_t>(size);
+    }
+
+    void get_remote_ip_and_port(std::string& ip, int& port) const override {
+        ip = connection_->remoteIp;
+        port = connection_->remotePort;
+    }
+
+    void get_local_ip_and_port(std::string& ip, int& port) const override {
+        ip = connection_->localIp;
+        port = connection_->localPort;
+    }
+
+    socket_t socket() const override { return connection_->fd; }
+
+    time_t duration() const override { return 0; }
+
+    // Puts bytes taken but not read back in front of the buffer, they belong to the next request
+    void returnUnread() {
+        if (pos_ == pending_.size()) return;
+        std::lock_guard<std::mutex> lock(connection_->mutex);
+        connection_->in.insert(0, pending_, pos_, std::string::npos);
+        pos_ = pending_.size();
+    }
+
+private:
+    EventLoopServer& server_;
+    std::shared_ptr<Connection> connection_;
+    std::chrono::microseconds readTimeout_;
+    std::chrono::microseconds writeTimeout_;
+    std::string pending_;
+    size_t pos_ = 0;
+};
+
+EventLoopServer::EventLoopServer(size_t loops)
+    : loopCount_(loops ? loops : std::max(1u, std::thread::hardware_concurrency())) {}
+
+EventLoopServer::~EventLoopServer() {
+    shutdown();
+}
+
+// Function to bind the listening socket and run the loops until shutdown()
+bool EventLoopServer::run(const std::string& host, int port, int backlog) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    addrinfo* result = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0) return false;
+    for (addrinfo* ai = result; ai && listenFd_ < 0; ai = ai->ai_next) {
+        int fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) continue;
+        int yes = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        if (::bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && ::listen(fd, backlog) == 0) listenFd_ = fd;
+        else ::close(fd);
+    }
+    freeaddrinfo(result);
+    if (listenFd_ < 0) return false;
+    // httplib stops streaming content providers once this reads INVALID_SOCKET
+    svr_sock_ = listenFd_;
+
+    executor_.reset(new_task_queue());
+    for (size_t i = 0; i < loopCount_; ++i) {
+        auto loop = std::make_unique<Loop>();
+        loop->epollFd = epoll_create1(EPOLL_CLOEXEC);
+        loop->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = loop->wakeFd;
+        epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, loop->wakeFd, &event);
+        // Every loop watches the listening socket; EPOLLEXCLUSIVE wakes only one per connection
+        event.events = EPOLLIN | EPOLLEXCLUSIVE;
+        event.data.fd = listenFd_;
+        epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, listenFd_, &event);
+        loops_.push_back(std::move(loop));
+    }
+    for (auto& loop : loops_) {
+        Loop* self = loop.get();
+        loop->thread = std::thread([this, self] { runLoop(*self); });
+    }
+    for (auto& loop : loops_) loop->thread.join();
+
+    // Fail every connection so workers blocked on one (e.g. an event stream) return
+    for (auto& loop : loops_) {
+        for (auto& [fd, connection] : loop->connections) {
+            std::lock_guard<std::mutex> lock(connection->mutex);
+            connection->failed = true;
+            connection->changed.notify_all();
+        }
+    }
+    executor_->shutdown();
+    executor_.reset();
+    for (auto& loop : loops_) {
+        for (auto& [fd, connection] : loop->connections) ::close(fd);
+        ::close(loop->epollFd);
+        ::close(loop->wakeFd);
+    }
+    loops_.clear();
+    connections_ = 0;
+    activeConnections_ = 0;
+    svr_sock_ = INVALID_SOCKET;
+    ::close(listenFd_);
+    listenFd_ = -1;
+    return true;
+}
+
+void EventLoopServer::shutdown() {
+    stopping_ = true;
+    for (auto& loop : loops_) {
+        uint64_t one = 1;
+        ssize_t ignored = ::write(loop->wakeFd, &one, sizeof(one));
+        (void)ignored;
+    }
+}
+
+// Function run by each event loop thread
+void EventLoopServer::runLoop(Loop& loop) {
+    epoll_event events[256];
+    auto lastSweep = Clock::now();
+    while (!stopping_) {
+        int count = epoll_wait(loop.epollFd, events, 256, 1000);
+        for (int i = 0; i < count; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == listenFd_) {
+                acceptConnections(loop);
+                continue;
+            }
+            if (fd == loop.wakeFd) {
+                uint64_t value;
+                while (::read(loop.wakeFd, &value, sizeof(value)) > 0) {
+                }
+                std::vector<std::shared_ptr<Connection>> posted;
+                {
+                    std::lock_guard<std::mutex> lock(loop.postedMutex);
+                    posted.swap(loop.posted);
+                }
+                // Connections a worker finished with, or that can be read again
+                for (auto& connection : posted) {
+                    flush(loop, connection);
+                    readFrom(loop, connection);
+                }
+                continue;
+            }
+            auto it = loop.connections.find(fd);
+            if (it == loop.connections.end()) continue;
+            std::shared_ptr<Connection> connection = it->second;
+            if (events[i].events & EPOLLERR) {
+                std::lock_guard<std::mutex> lock(connection->mutex);
+                connection->failed = true;
+                connection->changed.notify_all();
+            }
+            if (events[i].events & EPOLLOUT) flush(loop, connection);
+            readFrom(loop, connection);
+        }
+
+        auto now = Clock::now();
+        if (now - lastSweep >= IDLE_SWEEP_INTERVAL) {
+            lastSweep = now;
+            auto keepAlive = std::chrono::seconds(keep_alive_timeout_sec_);
+            std::vector<std::shared_ptr<Connection>> idle;
+            for (auto& [fd, connection] : loop.connections) {
+                std::lock_guard<std::mutex> lock(connection->mutex);
+                if (!connection->busy && connection->outPos == connection->out.size() && now - connection->lastActive > keepAlive) {
+                    idle.push_back(connection);
+                }
+            }
+            idleTimeouts_ += idle.size();
+            for (auto& connection : idle) closeConnection(loop, connection);
+        }
+    }
+}
+
+void EventLoopServer::acceptConnections(Loop& loop) {
+    for (int i = 0; i < ACCEPT_BATCH; ++i) {
+        int fd = ::accept4(listenFd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;
+        int yes = 1;
+        // Headers and body are separate writes, Nagle would hold the body back
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+        auto connection = std::make_shared<Connection>();
+        connection->fd = fd;
+        connection->loop = &loop;
+        httplib::detail::get_remote_ip_and_port(fd, connection->remoteIp, connection->remotePort);
+        httplib::detail::get_local_ip_and_port(fd, connection->localIp, connection->localPort);
+        loop.connections[fd] = connection;
+        ++accepted_;
+        ++connections_;
+
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.fd = fd;
+        epoll_ctl(loop.epollFd, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+
+// Function to read everything available and start a request once its headers are in
+void EventLoopServer::readFrom(Loop& loop, const std::shared_ptr<Connection>& connection) {
+    Connection& c = *connection;
+    bool start;
+    bool close;
+    {
+        std::lock_guard<std::mutex> lock(c.mutex);
+        // Edge-triggered, so keep reading until the socket says it is empty
+        char buffer[16384];
+        while (!c.failed && !c.peerClosed) {
+            if (c.in.size() >= MAX_BUFFERED_INPUT) {
+                // The worker resumes reading through post() once it has taken the input
+                c.readPaused = true;
+                break;
+            }
+            c.readPaused = false;
+            ssize_t n = ::recv(c.fd, buffer, sizeof(buffer), 0);
+            if (n > 0) {
+                c.in.append(buffer, static_cast<size_t>(n));
+                c.lastActive = Clock::now();
+            }
+            else if (n == 0) c.peerClosed = true;
+            else if (errno == EINTR) continue;
+            else if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            else c.failed = true;
+        }
+        c.changed.notify_all();
+        start = c.startRequest();
+        // A full buffer without the end of the headers will never become a request
+        if (!start && !c.busy && c.in.size() >= MAX_BUFFERED_INPUT) c.failed = true;
+        close = !start && !c.busy && (c.failed || ((c.peerClosed || c.closeWhenDone) && c.outPos == c.out.size()));
+    }
+    if (start) {
+        ++activeConnections_;
+        if (!executor_->enqueue([this, connection] { handle(connection); })) {
+            --activeConnections_;
+            std::lock_guard<std::mutex> lock(c.mutex);
+            c.busy = false;
+            c.failed = true;
+            close = true;
+        }
+    }
+    if (close) closeConnection(loop, connection);
+}
+
+// Function to send what workers left in a connection's output buffer
+void EventLoopServer::flush(Loop& loop, const std::shared_ptr<Connection>& connection) {
+    Connection& c = *connection;
+    bool close;
+    {
+        std::lock_guard<std::mutex> lock(c.mutex);
+        while (!c.failed && c.outPos < c.out.size()) {
+            ssize_t n = ::send(c.fd, c.out.data() + c.outPos, c.out.size() - c.outPos, MSG_NOSIGNAL);
+            if (n > 0) c.outPos += static_cast<size_t>(n);
+            else if (n < 0 && errno == EINTR) continue;
+            else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            else c.failed = true;
+        }
+        if (c.outPos == c.out.size()) {
+            c.out.clear();
+            c.outPos = 0;
+        }
+        c.changed.notify_all();
+        close = !c.busy && (c.failed || ((c.peerClosed || c.closeWhenDone) && c.out.empty()));
+    }
+    if (close) closeConnection(loop, connection);
+}
+
+// Function to drop a connection; only the loop closes descriptors, and never while a worker uses one
+void EventLoopServer::closeConnection(Loop& loop, const std::shared_ptr<Connection>& connection) {
+    {
+        std::lock_guard<std::mutex> lock(connection->mutex);
+        connection->failed = true;
+        connection->changed.notify_all();
+        if (connection->busy) return;
+    }
+    // The descriptor may already belong to a newer connection if this one was closed before
+    auto it = loop.connections.find(connection->fd);
+    if (it == loop.connections.end() || it->second != connection) return;
+    loop.connections.erase(it);
+    epoll_ctl(loop.epollFd, EPOLL_CTL_DEL, connection->fd, nullptr);
+    ::close(connection->fd);
+    --connections_;
+}
+
+void EventLoopServer::post(const std::shared_ptr<Connection>& connection) {
+    Loop& loop = *connection->loop;
+    {
+        std::lock_guard<std::mutex> lock(loop.postedMutex);
+        loop.posted.push_back(connection);
+    }
+    uint64_t one = 1;
+    ssize_t ignored = ::write(loop.wakeFd, &one, sizeof(one));
+    (void)ignored;
+}
+
+// Function run on a worker: process one request, then the next if it is already buffered
+void EventLoopServer::handle(const std::shared_ptr<Connection>& connection) {
+    Connection& c = *connection;
+    for (;;) {
+        ConnectionStream stream(*this, connection,
+            std::chrono::seconds(read_timeout_sec_) + std::chrono::microseconds(read_timeout_usec_),
+            std::chrono::seconds(write_timeout_sec_) + std::chrono::microseconds(write_timeout_usec_));
+        bool closeAfter = c.served + 1 >= keep_alive_max_count_ || stopping_;
+        bool connectionClosed = false;
+        bool ok = process_request(stream, c.remoteIp, c.remotePort, c.localIp, c.localPort,
+            closeAfter, connectionClosed, nullptr);
+        stream.returnUnread();
+        ++requests_;
+
+        bool next;
+        bool needsLoop;
+        {
+            std::lock_guard<std::mutex> lock(c.mutex);
+            ++c.served;
+            c.lastActive = Clock::now();
+            c.busy = false;
+            if (!ok || connectionClosed || closeAfter) c.closeWhenDone = true;
+            // Pipelined requests are handled right away on this worker
+            next = c.startRequest();
+            needsLoop = !next && (c.closeWhenDone || c.failed || c.peerClosed || c.readPaused || c.outPos < c.out.size());
+        }
+        if (next) continue;
+        --activeConnections_;
+        // The loop closes the connection, or resumes reading it
+        if (needsLoop) post(connection);
+        return;
+    }
+}
+
+EventLoopStats EventLoopServer::stats() const {
+    EventLoopStats stats;
+    stats.loops = loopCount_;
+    stats.connections = connections_;
+    stats.activeConnections = activeConnections_;
+    stats.accepted = accepted_;
+    stats.requests = requests_;
+    stats.idleTimeouts = idleTimeouts_;
+    return stats;
+}
+
+#endif // __linux__
@@ -0,0 +1,76 @@
+﻿#ifndef EVENT_LOOP_SERVER_H
+#define EVENT_LOOP_SERVER_H
+
+#include "httplib.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Counters describing the event loops
+struct EventLoopStats {
+    size_t loops = 0;
+    // Connections open right now, and those with a request being handled
+    size_t connections = 0;
+    size_t activeConnections = 0;
+    uint64_t accepted = 0;
+    uint64_t requests = 0;
+    // Connections closed for staying idle longer than the keep-alive timeout
+    uint64_t idleTimeouts = 0;
+};
+
+#ifdef __linux__
+
+// HTTP server built on non-blocking sockets and epoll, for many mostly idle connections.
+// httplib::Server ties up a worker thread per connection for as long as it
+// is kept alive, so idle clients starve the pool. Here every connection
+// belongs to one of several event loops, which read until a request's
+// headers are complete and only then hand the request to the executor
+// (new_task_queue). The worker runs it through httplib's own request
+// processing, so the routes registered on this object work unchanged,
+// including streamed responses; its reads and writes go through buffers the
+// loop fills and drains, and the connection returns to the loop afterwards.
+class EventLoopServer : public httplib::Server {
+public:
+    // loops == 0 starts one loop per core
+    explicit EventLoopServer(size_t loops = 0);
+    ~EventLoopServer() override;
+
+    // Binds host:port and serves until shutdown() is called; returns false if it could not bind
+    bool run(const std::string& host, int port, int backlog = SOMAXCONN);
+    void shutdown();
+
+    EventLoopStats stats() const;
+
+private:
+    struct Connection;
+    struct Loop;
+    class ConnectionStream;
+
+    void runLoop(Loop& loop);
+    void acceptConnections(Loop& loop);
+    void readFrom(Loop& loop, const std::shared_ptr<Connection>& connection);
+    void flush(Loop& loop, const std::shared_ptr<Connection>& connection);
+    void closeConnection(Loop& loop, const std::shared_ptr<Connection>& connection);
+    // Hands a connection back to its loop from a worker thread
+    void post(const std::shared_ptr<Connection>& connection);
+    // Runs one request of a connection on a worker thread
+    void handle(const std::shared_ptr<Connection>& connection);
+
+    size_t loopCount_;
+    std::vector<std::unique_ptr<Loop>> loops_;
+    std::unique_ptr<httplib::TaskQueue> executor_;
+    int listenFd_ = -1;
+    std::atomic<bool> stopping_{ false };
+
+    std::atomic<size_t> connections_{ 0 };
+    std::atomic<size_t> activeConnections_{ 0 };
+    std::atomic<uint64_t> accepted_{ 0 };
+    std::atomic<uint64_t> requests_{ 0 };
+    std::atomic<uint64_t> idleTimeouts_{ 0 };
+};
+
+#endif // __linux__
+
+#endif // EVENT_LOOP_SERVER_H
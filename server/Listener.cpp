@@ -0,0 +1,96 @@
+﻿#include "Listener.h"
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+// Executor wrapper that counts the connections the acceptor hands over
+class Listener::CountingQueue : public httplib::TaskQueue {
+public:
+    CountingQueue(httplib::TaskQueue* queue, Listener& listener) : queue_(queue), listener_(listener) {}
+
+    bool enqueue(std::function<void()> fn) override {
+        listener_.recordAccept();
+        if (queue_->enqueue(std::move(fn))) return true;
+        ++listener_.rejected_;
+        return false;
+    }
+    void shutdown() override { queue_->shutdown(); }
+    void on_idle() override { queue_->on_idle(); }
+
+private:
+    std::unique_ptr<httplib::TaskQueue> queue_;
+    Listener& listener_;
+};
+
+Listener::Listener(int backlog) : backlog_(backlog), started_(std::chrono::steady_clock::now()) {
+    for (size_t i = 0; i < RATE_SLOTS; ++i) {
+        slotSecond_[i] = -1;
+        slotCount_[i] = 0;
+    }
+    // SO_REUSEPORT lets every listener bind the same port, SO_REUSEADDR lets a restart bind over TIME_WAIT
+    set_socket_options([](socket_t sock) {
+        int opt = 1;
+#ifdef _WIN32
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&opt), sizeof(opt));
+#else
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+#ifdef SO_REUSEPORT
+        setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+#endif
+#endif
+        });
+}
+
+bool Listener::bind(const std::string& host, int port) {
+    if (!bind_to_port(host, port)) return false;
+    // httplib has already called listen() with its own backlog. Calling it
+    // again on the listening socket resizes the accept queue on Linux and the
+    // BSDs (Windows keeps the first value, the kernel caps it at somaxconn)
+    ::listen(svr_sock_, backlog_);
+    return true;
+}
+
+void Listener::setExecutor(std::function<httplib::TaskQueue*()> newQueue) {
+    new_task_queue = [this, newQueue] { return new CountingQueue(newQueue(), *this); };
+}
+
+void Listener::recordAccept() {
+    ++accepted_;
+    int64_t second = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - started_).count();
+    size_t slot = static_cast<size_t>(second) % RATE_SLOTS;
+    // Only the acceptor thread writes the slots; stats() may catch one being
+    // reset and be off by a few accepts, which is fine for a rate
+    if (slotSecond_[slot].load(std::memory_order_relaxed) != second) {
+        slotCount_[slot].store(0, std::memory_order_relaxed);
+        slotSecond_[slot].store(second, std::memory_order_relaxed);
+    }
+    slotCount_[slot].fetch_add(1, std::memory_order_relaxed);
+}
+
+ListenerStats Listener::stats() const {
+    ListenerStats stats;
+    stats.backlog = backlog_;
+    stats.accepted = accepted_;
+    stats.rejected = rejected_;
+
+    // Average over the last RATE_WINDOW whole seconds, leaving out the one still running
+    int64_t now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - started_).count();
+    int64_t window = std::min(RATE_WINDOW, now);
+    uint64_t count = 0;
+    for (size_t i = 0; i < RATE_SLOTS; ++i) {
+        int64_t second = slotSecond_[i].load(std::memory_order_relaxed);
+        if (second >= now - window && second < now) count += slotCount_[i].load(std::memory_order_relaxed);
+    }
+    stats.acceptsPerSecond = window ? double(count) / window : 0.0;
+
+#ifdef __linux__
+    // For a listening socket tcpi_unacked is the accept queue's current length
+    socket_t sock = svr_sock_;
+    tcp_info info{};
+    socklen_t length = sizeof(info);
+    if (sock != INVALID_SOCKET && getsockopt(sock, IPPROTO_TCP, TCP_INFO, &info, &length) == 0) {
+        stats.pending = info.tcpi_unacked;
+    }
+#endif
+    return stats;
+}
@@ -0,0 +1,60 @@
+﻿#ifndef LISTENER_H
+#define LISTENER_H
+
+#include "httplib.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Counters describing one listening socket
+struct ListenerStats {
+    int backlog = 0;
+    uint64_t accepted = 0;
+    // Average over the last few whole seconds
+    double acceptsPerSecond = 0;
+    // Connections the executor refused (only while shutting down), closed unserved
+    uint64_t rejected = 0;
+    // Connections waiting in the kernel's accept queue right now (Linux only)
+    size_t pending = 0;
+};
+
+// httplib::Server with its own listening socket, for running several on one port.
+// httplib listens with the compile-time CPPHTTPLIB_LISTEN_BACKLOG of 5, so a
+// burst of connects overflows the accept queue and clients see retransmitted
+// SYNs or refusals. bind() sets the backlog given here instead, and binds
+// with SO_REUSEPORT so that on Linux every listener on the same port gets
+// its own accept queue and the kernel spreads new connections across them.
+// Each listener accepts on the thread that calls listen_after_bind() and
+// runs connections on its own executor; routes are registered as usual.
+class Listener : public httplib::Server {
+public:
+    explicit Listener(int backlog = SOMAXCONN);
+
+    // Binds host:port and applies the backlog; returns false if it could not bind
+    bool bind(const std::string& host, int port);
+    // Installs the executor factory (as new_task_queue), counting the connections handed to it
+    void setExecutor(std::function<httplib::TaskQueue*()> newQueue);
+
+    ListenerStats stats() const;
+
+private:
+    class CountingQueue;
+
+    // Called by the acceptor thread for every accepted connection
+    void recordAccept();
+
+    // Accepts per second are kept in a ring of one-second slots
+    static const size_t RATE_SLOTS = 16;
+    static const int64_t RATE_WINDOW = 10;
+
+    int backlog_;
+    std::chrono::steady_clock::time_point started_;
+    std::atomic<uint64_t> accepted_{ 0 };
+    std::atomic<uint64_t> rejected_{ 0 };
+    std::atomic<int64_t> slotSecond_[RATE_SLOTS];
+    std::atomic<uint64_t> slotCount_[RATE_SLOTS];
+};
+
+#endif // LISTENER_H
@@ -0,0 +1,211 @@
+﻿#include "Metrics.h"
+#include <cmath>
+#include <cstdio>
+#include <utility>
+
+// Function to find the position of the highest set bit
+static int highestBit(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(value);
+#else
+    int bit = 0;
+    while (value >>= 1) ++bit;
+    return bit;
+#endif
+}
+
+// Function to find the bucket of a value when buckets include their lower
+// edge: below 16 each value alone, then 8 per power of two
+static size_t floorBucket(uint64_t value) {
+    const int SUB_BITS = LatencyHistogram::SUB_BITS;
+    const uint64_t subBuckets = uint64_t(1) << SUB_BITS;
+    if (value < 2 * subBuckets) return static_cast<size_t>(value);
+    int exponent = highestBit(value);
+    size_t bucket = (static_cast<size_t>(exponent - SUB_BITS + 1) << SUB_BITS)
+        + static_cast<size_t>((value >> (exponent - SUB_BITS)) - subBuckets);
+    return bucket < LatencyHistogram::BUCKETS ? bucket : LatencyHistogram::BUCKETS - 1;
+}
+
+// Function to find the smallest value of a bucket in floorBucket()'s layout
+static uint64_t floorLowerBound(size_t bucket) {
+    const int SUB_BITS = LatencyHistogram::SUB_BITS;
+    const size_t subBuckets = size_t(1) << SUB_BITS;
+    if (bucket < 2 * subBuckets) return bucket;
+    int exponent = static_cast<int>(bucket >> SUB_BITS) + SUB_BITS - 1;
+    uint64_t mantissa = (bucket & (subBuckets - 1)) + subBuckets;
+    return mantissa << (exponent - SUB_BITS);
+}
+
+// Buckets are floorBucket()'s shifted up by one value, so each one ends on
+// an edge instead of starting on it
+size_t LatencyHistogram::bucketOf(uint64_t value) {
+    return floorBucket(value > 0 ? value - 1 : 0);
+}
+
+uint64_t LatencyHistogram::lowerBound(size_t bucket) {
+    return bucket == 0 ? 0 : floorLowerBound(bucket) + 1;
+}
+
+uint64_t LatencyHistogram::upperBound(size_t bucket) {
+    return bucket + 1 < BUCKETS ? floorLowerBound(bucket + 1) : UINT64_MAX;
+}
+
+void LatencyHistogram::record(uint64_t value) {
+    ++counts[bucketOf(value)];
+    ++count;
+    sum += value;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < BUCKETS; ++i) counts[i] += other.counts[i];
+    count += other.count;
+    sum += other.sum;
+}
+
+uint64_t LatencyHistogram::countAtMost(uint64_t limit) const {
+    uint64_t atMost = 0;
+    // The last bucket is open-ended, so it is never entirely within a limit
+    for (size_t i = 0; i + 1 < BUCKETS && upperBound(i) <= limit; ++i) atMost += counts[i];
+    return atMost;
+}
+
+uint64_t LatencyHistogram::quantile(double q) const {
+    if (count == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(std::ceil(q * count));
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        seen += counts[i];
+        if (seen >= rank) return i + 1 < BUCKETS ? upperBound(i) : lowerBound(i);
+    }
+    return lowerBound(BUCKETS - 1);
+}
+
+// Counters written only by the thread holding the shard
+struct RequestMetrics::Shard {
+    struct Route {
+        std::array<std::atomic<uint64_t>, STATUS_CLASSES> responses{};
+        std::atomic<uint64_t> count{ 0 };
+        std::atomic<uint64_t> sum{ 0 };
+        std::array<std::atomic<uint64_t>, LatencyHistogram::BUCKETS> counts{};
+    };
+
+    explicit Shard(size_t routes) : routes(new Route[routes]()) {}
+
+    std::unique_ptr<Route[]> routes;
+};
+
+// Shards taken by the current thread, given back when it exits
+struct RequestMetrics::ThreadShards {
+    std::vector<std::pair<RequestMetrics*, Shard*>> held;
+
+    ~ThreadShards() {
+        for (auto& entry : held) entry.first->release(entry.second);
+    }
+};
+
+RequestMetrics::RequestMetrics(size_t routes) : routes_(routes) {}
+
+RequestMetrics::~RequestMetrics() = default;
+
+RequestMetrics::Shard& RequestMetrics::localShard() {
+    static thread_local ThreadShards local;
+    for (auto& entry : local.held) {
+        if (entry.first == this) return *entry.second;
+    }
+    // First request recorded on this thread
+    Shard* shard;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!freeShards_.empty()) {
+            shard = freeShards_.back();
+            freeShards_.pop_back();
+        }
+        else {
+            shards_.push_back(std::make_unique<Shard>(routes_));
+            shard = shards_.back().get();
+        }
+    }
+    local.held.emplace_back(this, shard);
+    return *shard;
+}
+
+void RequestMetrics::release(Shard* shard) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    freeShards_.push_back(shard);
+}
+
+// Function to add to a counter only the calling thread writes; a plain
+// load and store, which unlike fetch_add needs no locked instruction
+static void bump(std::atomic<uint64_t>& counter, uint64_t by) {
+    counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+}
+
+void RequestMetrics::record(size_t route, int status, uint64_t nanoseconds) {
+    if (route >= routes_) return;
+    Shard::Route& cells = localShard().routes[route];
+    size_t statusClass = status >= 100 && status < 600 ? static_cast<size_t>(status / 100 - 1) : STATUS_CLASSES - 1;
+    bump(cells.responses[statusClass], 1);
+    bump(cells.counts[LatencyHistogram::bucketOf(nanoseconds)], 1);
+    bump(cells.count, 1);
+    bump(cells.sum, nanoseconds);
+}
+
+std::vector<RequestMetrics::Route> RequestMetrics::snapshot() const {
+    std::vector<Route> routes(routes_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& shard : shards_) {
+        for (size_t r = 0; r < routes_; ++r) {
+            const Shard::Route& cells = shard->routes[r];
+            Route& route = routes[r];
+            for (size_t i = 0; i < STATUS_CLASSES; ++i) route.responses[i] += cells.responses[i].load(std::memory_order_relaxed);
+            for (size_t i = 0; i < LatencyHistogram::BUCKETS; ++i) route.latency.counts[i] += cells.counts[i].load(std::memory_order_relaxed);
+            route.latency.count += cells.count.load(std::memory_order_relaxed);
+            route.latency.sum += cells.sum.load(std::memory_order_relaxed);
+        }
+    }
+    return routes;
+}
+
+// Function to format a sample value the way Prometheus parses it
+static std::string formatValue(double value) {
+    if (std::isinf(value)) return value > 0 ? "+Inf" : "-Inf";
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.15g", value);
+    return buffer;
+}
+
+void appendMetricHeader(std::string& out, const std::string& name, const std::string& type, const std::string& help) {
+    out += "# HELP " + name + " " + help + "\n";
+    out += "# TYPE " + name + " " + type + "\n";
+}
+
+void appendMetric(std::string& out, const std::string& name, const std::string& labels, double value) {
+    out += name;
+    if (!labels.empty()) out += "{" + labels + "}";
+    out += " " + formatValue(value) + "\n";
+}
+
+// Function to join a series' labels with one more
+static std::string withLabel(const std::string& labels, const std::string& label) {
+    return labels.empty() ? label : labels + "," + label;
+}
+
+void appendHistogram(std::string& out, const std::string& name, const std::string& labels, const LatencyHistogram& histogram) {
+    // 2^10 ns (about 1 us) to 2^34 ns (about 17 s); buckets end on powers of two so the counts are exact
+    for (int exponent = 10; exponent <= 34; ++exponent) {
+        uint64_t limit = uint64_t(1) << exponent;
+        appendMetric(out, name + "_bucket", withLabel(labels, "le=\"" + formatValue(limit / 1e9) + "\""), double(histogram.countAtMost(limit)));
+    }
+    appendMetric(out, name + "_bucket", withLabel(labels, "le=\"+Inf\""), double(histogram.count));
+    appendMetric(out, name + "_sum", labels, histogram.sum / 1e9);
+    appendMetric(out, name + "_count", labels, double(histogram.count));
+}
+
+void appendQuantiles(std::string& out, const std::string& name, const std::string& labels, const LatencyHistogram& histogram) {
+    for (const char* q : { "0.5", "0.9", "0.99", "0.999" }) {
+        appendMetric(out, name, withLabel(labels, std::string("quantile=\"") + q + "\""), histogram.quantile(std::stod(q)) / 1e9);
+    }
+    appendMetric(out, name + "_sum", labels, histogram.sum / 1e9);
+    appendMetric(out, name + "_count", labels, double(histogram.count));
+}
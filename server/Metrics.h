@@ -0,0 +1,89 @@
+﻿#ifndef METRICS_H
+#define METRICS_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Latency histogram with log-linear buckets in the style of HdrHistogram.
+// Values are nanoseconds. Up to 16 every value has its own bucket; above
+// that each power of two is split into 8 buckets, so a value is never more
+// than 12.5% away from its bucket's bounds. A bucket includes its upper
+// edge, like a Prometheus le bucket, and powers of two are upper edges, so
+// the Prometheus output counts values at or below each of them exactly.
+struct LatencyHistogram {
+    static const int SUB_BITS = 3;
+    // Largest power of two kept apart, slower values land in the last bucket (~18 minutes)
+    static const int MAX_EXPONENT = 40;
+    static const size_t BUCKETS = (MAX_EXPONENT - SUB_BITS + 1) << SUB_BITS;
+
+    std::array<uint64_t, BUCKETS> counts{};
+    uint64_t count = 0;
+    uint64_t sum = 0;
+
+    static size_t bucketOf(uint64_t value);
+    // Smallest and largest value that fall in a bucket
+    static uint64_t lowerBound(size_t bucket);
+    static uint64_t upperBound(size_t bucket);
+
+    void record(uint64_t value);
+    void merge(const LatencyHistogram& other);
+    // Values at or below limit, exact when limit is a power of two
+    uint64_t countAtMost(uint64_t limit) const;
+    // Largest value of the bucket holding the q-th value (q in [0, 1]), 0 when empty
+    uint64_t quantile(double q) const;
+};
+
+// Per-route request counters and latency histograms for GET /metrics.
+// Recording sits on every request, so each thread writes to a shard of its
+// own that it takes on first use: a relaxed load and store per counter,
+// with no lock and no cache line shared with other threads. snapshot() adds
+// the shards up. A thread's shard goes back to a free list when the thread
+// exits and is reused by the next new one, so its counts are never lost.
+class RequestMetrics {
+public:
+    // Number of status classes counted: 1xx to 5xx
+    static const size_t STATUS_CLASSES = 5;
+
+    struct Route {
+        std::array<uint64_t, STATUS_CLASSES> responses{};
+        LatencyHistogram latency;
+    };
+
+    // routes is the number of route slots, fixed for the object's lifetime
+    explicit RequestMetrics(size_t routes);
+    ~RequestMetrics();
+
+    RequestMetrics(const RequestMetrics&) = delete;
+    RequestMetrics& operator=(const RequestMetrics&) = delete;
+
+    void record(size_t route, int status, uint64_t nanoseconds);
+    std::vector<Route> snapshot() const;
+
+private:
+    struct Shard;
+    struct ThreadShards;
+
+    Shard& localShard();
+    void release(Shard* shard);
+
+    size_t routes_;
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::vector<Shard*> freeShards_;
+};
+
+// Functions to write Prometheus text exposition format. labels is either
+// empty or a list like method="GET",route="/tasks" without the braces.
+void appendMetricHeader(std::string& out, const std::string& name, const std::string& type, const std::string& help);
+void appendMetric(std::string& out, const std::string& name, const std::string& labels, double value);
+// Writes _bucket lines at every power of two from 1 microsecond to ~17 seconds, then _sum and _count, in seconds
+void appendHistogram(std::string& out, const std::string& name, const std::string& labels, const LatencyHistogram& histogram);
+// Writes p50/p90/p99/p999 (as a Prometheus summary), then _sum and _count, in seconds
+void appendQuantiles(std::string& out, const std::string& name, const std::string& labels, const LatencyHistogram& histogram);
+
+#endif // METRICS_H
@@ -0,0 +1,38 @@
+﻿#include "ResponseCache.h"
+
+// Function to fetch the cached body, rebuilding it if the store has moved on
+std::shared_ptr<const CachedResponse> ResponseCache::get(uint64_t version, const std::function<std::string()>& build) {
+    auto cached = std::atomic_load(&current_);
+    if (cached && cached->version == version) {
+        return cached;
+    }
+
+    std::lock_guard<std::mutex> lock(buildMutex_);
+    // Another request may have rebuilt it while we waited
+    cached = std::atomic_load(&current_);
+    if (cached && cached->version == version) {
+        return cached;
+    }
+
+    auto built = std::make_shared<CachedResponse>();
+    built->version = version;
+    built->body = build();
+    std::shared_ptr<const CachedResponse> fresh = std::move(built);
+    // Never replace a body for a newer version with one for an older version
+    if (!cached || cached->version < version) {
+        std::atomic_store(&current_, fresh);
+    }
+    return fresh;
+}
+
+const std::string* CachedResponse::encoded(ContentCoding coding) const {
+    if (coding == ContentCoding::Gzip) {
+        std::call_once(gzipOnce_, [this] { gzipOk_ = compressBody(body, ContentCoding::Gzip, gzip_); });
+        return gzipOk_ ? &gzip_ : nullptr;
+    }
+    if (coding == ContentCoding::Deflate) {
+        std::call_once(deflateOnce_, [this] { deflateOk_ = compressBody(body, ContentCoding::Deflate, deflate_); });
+        return deflateOk_ ? &deflate_ : nullptr;
+    }
+    return &body;
+}
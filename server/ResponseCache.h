@@ -0,0 +1,45 @@
+﻿#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include "Compression.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// A response body serialized for one version of the task store
+struct CachedResponse {
+    uint64_t version = 0;
+    std::string body;
+
+    // The body compressed with a coding, or nullptr if compression failed.
+    // Each coding is compressed at most once per version, on first request,
+    // and kept for as long as the version is cached.
+    const std::string* encoded(ContentCoding coding) const;
+
+private:
+    mutable std::once_flag gzipOnce_;
+    mutable std::once_flag deflateOnce_;
+    mutable std::string gzip_;
+    mutable std::string deflate_;
+    mutable bool gzipOk_ = false;
+    mutable bool deflateOk_ = false;
+};
+
+// Keeps the most recently serialized body of a read endpoint.
+// Bodies are keyed by store version, so any POST/PUT/DELETE (which
+// publishes a new version) invalidates the cached body automatically.
+class ResponseCache {
+public:
+    // Returns the body for the given version, calling build() only if the
+    // cache holds an older one. Concurrent misses build the body once.
+    std::shared_ptr<const CachedResponse> get(uint64_t version, const std::function<std::string()>& build);
+
+private:
+    std::shared_ptr<const CachedResponse> current_;
+    // Serializes rebuilds so a burst of misses doesn't serialize the store N times
+    std::mutex buildMutex_;
+};
+
+#endif // RESPONSE_CACHE_H
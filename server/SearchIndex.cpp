@@ -0,0 +1,412 @@
+﻿#include "SearchIndex.h"
+#include <algorithm>
+#include <iterator>
+#include <mutex>
+
+// Function to decide whether a byte is part of a word
+static bool isWordByte(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c >= 0x80;
+}
+
+std::vector<std::string> SearchIndex::tokenize(std::string_view text) {
+    std::vector<std::string> words;
+    std::string word;
+    for (size_t i = 0; i <= text.size(); ++i) {
+        unsigned char c = i < text.size() ? static_cast<unsigned char>(text[i]) : ' ';
+        if (isWordByte(c)) {
+            word += (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : static_cast<char>(c);
+        }
+        else if (!word.empty()) {
+            words.push_back(std::move(word));
+            word.clear();
+        }
+    }
+    return words;
+}
+
+// Function to reduce a word list to distinct words
+static std::vector<std::string> distinctWords(std::string_view text) {
+    std::vector<std::string> words = SearchIndex::tokenize(text);
+    std::sort(words.begin(), words.end());
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+    return words;
+}
+
+void SearchIndex::addWords(int id, const std::vector<std::string>& words) {
+    for (const auto& word : words) {
+        std::vector<int>& list = postings_[word];
+        // IDs mostly arrive in increasing order, so this is nearly always an append
+        if (list.empty() || list.back() < id) {
+            list.push_back(id);
+            continue;
+        }
+        auto it = std::lower_bound(list.begin(), list.end(), id);
+        if (it == list.end() || *it != id) list.insert(it, id);
+    }
+}
+
+void SearchIndex::removeWords(int id, const std::vector<std::string>& words) {
+    for (const auto& word : words) {
+        auto entry = postings_.find(word);
+        if (entry == postings_.end()) continue;
+        std::vector<int>& list = entry->second;
+        auto it = std::lower_bound(list.begin(), list.end(), id);
+        if (it != list.end() && *it == id) list.erase(it);
+        if (list.empty()) postings_.erase(entry);
+    }
+}
+
+void SearchIndex::add(int id, std::string_view description) {
+    std::vector<std::string> words = distinctWords(description);
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    addWords(id, words);
+}
+
+void SearchIndex::remove(int id, std::string_view description) {
+    std::vector<std::string> words = distinctWords(description);
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    removeWords(id, words);
+}
+
+// Function to touch only the lists of words that were added or dropped
+void SearchIndex::update(int id, std::string_view oldDescription, std::string_view newDescription) {
+    std::vector<std::string> oldWords = distinctWords(oldDescription);
+    std::vector<std::string> newWords = distinctWords(newDescription);
+    std::vector<std::string> dropped;
+    std::vector<std::string> added;
+    std::set_difference(oldWords.begin(), oldWords.end(), newWords.begin(), newWords.end(), std::back_inserter(dropped));
+    std::set_difference(newWords.begin(), newWords.end(), oldWords.begin(), oldWords.end(), std::back_inserter(added));
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    removeWords(id, dropped);
+    addWords(id, added);
+}
+
+void SearchIndex::clear() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    postings_.clear();
+}
+
+// Function to intersect sorted lists, smallest first so the result shrinks fast.
+// Each lookup gallops forward from the previous match, which keeps a short
+// list against a long one close to O(short * log(long)).
+static std::vector<int> intersect(std::vector<const std::vector<int>*> lists) {
+    std::sort(lists.begin(), lists.end(), [](const auto* a, const auto* b) { return a->size() < b->size(); });
+    std::vector<int> result = *lists[0];
+    for (size_t i = 1; i < lists.size() && !result.empty(); ++i) {
+        const std::vector<int>& list = *lists[i];
+        std::vector<int> kept;
+        auto from = list.begin();
+        for (int id : result) {
+            // Double the step until we pass id, then binary search that range
+            size_t step = 1;
+            auto to = from;
+            while (to != list.end() && *to < id) {
+                from = to;
+                to = static_cast<size_t>(list.end() - to) > step ? to + step : list.end();
+                step *= 2;
+            }
+            from = std::lower_bound(from, to, id);
+            if (from == list.end()) break;
+            if (*from == id) kept.push_back(id);
+        }
+        result.swap(kept);
+    }
+    return result;
+}
+
+std::vector<int> SearchIndex::search(std::string_view query) const {
+    // Split the query into OR-separated groups of words
+    std::vector<std::vector<std::string>> groups(1);
+    size_t pos = 0;
+    while (pos < query.size()) {
+        size_t end = query.find_first_of(" \t", pos);
+        if (end == std::string_view::npos) end = query.size();
+        std::string_view term = query.substr(pos, end - pos);
+        pos = end + 1;
+        if (term.empty() || term == "AND") continue;
+        if (term == "OR") {
+            if (!groups.back().empty()) groups.emplace_back();
+            continue;
+        }
+        for (auto& word : tokenize(term)) groups.back().push_back(std::move(word));
+    }
+
+    std::vector<int> result;
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    for (const auto& group : groups) {
+        if (group.empty()) continue;
+        std::vector<const std::vector<int>*> lists;
+        bool missing = false;
+        for (const auto& word : group) {
+            auto entry = postings_.find(word);
+            if (entry == postings_.end()) {
+                // A word no task uses means the whole group matches nothing
+                missing = true;
+                break;
+            }
+            lists.push_back(&entry->second);
+        }
+        if (missing) continue;
+        std::vector<int> matches = intersect(std::move(lists));
+        // Merge this group's matches into the result, keeping it sorted and unique
+        std::vector<int> merged;
+        merged.reserve(result.size() + matches.size());
+        std::set_union(result.begin(), result.end(), matches.begin(), matches.end(), std::back_inserter(merged));
+        result.swap(merged);
+    }
+    return result;
+}
+
+size_t SearchIndex::wordCount() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return postings_.size();
+}
+
+size_t SearchIndex::memoryUsage() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    size_t total = postings_.bucket_count() * sizeof(void*);
+    for (const auto& [word, list] : postings_) {
+        total += sizeof(std::pair<const std::string, std::vector<int>>) + sizeof(void*) + word.capacity()
+            + list.capacity() * sizeof(int);
+    }
+    return total;
+}
+
+// Function to append an unsigned value in 7-bit groups, low bits first
+static void putVarint(std::string& out, uint32_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+TrigramIndex::PostingList::Block TrigramIndex::PostingList::encodeBlock(const int* ids, size_t count) {
+    Block block;
+    block.first = ids[0];
+    block.last = ids[count - 1];
+    block.count = static_cast<uint32_t>(count);
+    for (size_t i = 1; i < count; ++i) {
+        putVarint(block.bytes, static_cast<uint32_t>(ids[i] - ids[i - 1]));
+    }
+    return block;
+}
+
+void TrigramIndex::PostingList::decodeBlock(const Block& block, std::vector<int>& ids) {
+    int id = block.first;
+    ids.push_back(id);
+    const unsigned char* in = reinterpret_cast<const unsigned char*>(block.bytes.data());
+    for (uint32_t i = 1; i < block.count; ++i) {
+        uint32_t gap = 0;
+        for (int shift = 0;; shift += 7) {
+            unsigned char byte = *in++;
+            gap |= static_cast<uint32_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) break;
+        }
+        id += static_cast<int>(gap);
+        ids.push_back(id);
+    }
+}
+
+size_t TrigramIndex::PostingList::blockFor(int id) const {
+    auto it = std::upper_bound(blocks_.begin(), blocks_.end(), id,
+        [](int value, const Block& block) { return value < block.first; });
+    return it == blocks_.begin() ? 0 : static_cast<size_t>(it - blocks_.begin()) - 1;
+}
+
+void TrigramIndex::PostingList::rewriteBlock(size_t index, const std::vector<int>& ids) {
+    if (ids.empty()) {
+        blocks_.erase(blocks_.begin() + index);
+        return;
+    }
+    // A block that overflowed is split in two halves
+    size_t half = ids.size() > BLOCK_IDS ? ids.size() / 2 : ids.size();
+    blocks_[index] = encodeBlock(ids.data(), half);
+    if (half < ids.size()) {
+        blocks_.insert(blocks_.begin() + index + 1, encodeBlock(ids.data() + half, ids.size() - half));
+    }
+}
+
+// Function to add an ID, appending to the last block in the common case
+void TrigramIndex::PostingList::insert(int id) {
+    if (blocks_.empty() || (id > blocks_.back().last && blocks_.back().count >= BLOCK_IDS)) {
+        blocks_.push_back(encodeBlock(&id, 1));
+        ++size_;
+        return;
+    }
+    Block& tail = blocks_.back();
+    if (id > tail.last) {
+        putVarint(tail.bytes, static_cast<uint32_t>(id - tail.last));
+        tail.last = id;
+        ++tail.count;
+        ++size_;
+        return;
+    }
+    size_t index = blockFor(id);
+    std::vector<int> ids;
+    decodeBlock(blocks_[index], ids);
+    auto it = std::lower_bound(ids.begin(), ids.end(), id);
+    if (it != ids.end() && *it == id) return;
+    ids.insert(it, id);
+    ++size_;
+    rewriteBlock(index, ids);
+}
+
+void TrigramIndex::PostingList::erase(int id) {
+    if (blocks_.empty()) return;
+    size_t index = blockFor(id);
+    if (id < blocks_[index].first || id > blocks_[index].last) return;
+    std::vector<int> ids;
+    decodeBlock(blocks_[index], ids);
+    auto it = std::lower_bound(ids.begin(), ids.end(), id);
+    if (it == ids.end() || *it != id) return;
+    ids.erase(it);
+    --size_;
+    rewriteBlock(index, ids);
+}
+
+void TrigramIndex::PostingList::decode(std::vector<int>& ids) const {
+    ids.reserve(ids.size() + size_);
+    for (const Block& block : blocks_) decodeBlock(block, ids);
+}
+
+// Function to keep only candidates present in this list. Blocks are found
+// by binary search on their first ID and only blocks that could hold a
+// candidate are decoded.
+void TrigramIndex::PostingList::intersect(std::vector<int>& ids) const {
+    std::vector<int> kept;
+    std::vector<int> decoded;
+    size_t decodedIndex = SIZE_MAX;
+    auto from = blocks_.begin();
+    for (int id : ids) {
+        from = std::upper_bound(from, blocks_.end(), id, [](int value, const Block& block) { return value < block.first; });
+        if (from == blocks_.begin()) continue;
+        --from;
+        if (id > from->last) continue;
+        size_t index = static_cast<size_t>(from - blocks_.begin());
+        if (index != decodedIndex) {
+            decoded.clear();
+            decodeBlock(*from, decoded);
+            decodedIndex = index;
+        }
+        if (std::binary_search(decoded.begin(), decoded.end(), id)) kept.push_back(id);
+    }
+    ids.swap(kept);
+}
+
+size_t TrigramIndex::PostingList::memoryUsage() const {
+    size_t total = blocks_.capacity() * sizeof(Block);
+    for (const Block& block : blocks_) total += block.bytes.capacity();
+    return total;
+}
+
+// Function to list the distinct trigrams of a text after lowercasing it and
+// turning non-word bytes into spaces. With wordStart, a space is put in
+// front so the first word gets a " xy" trigram like every other word.
+std::vector<uint32_t> TrigramIndex::trigrams(std::string_view text, bool wordStart) {
+    std::string normalized = wordStart ? " " : "";
+    normalized.reserve(text.size() + 1);
+    for (char ch : text) {
+        unsigned char c = static_cast<unsigned char>(ch);
+        if (!isWordByte(c)) c = ' ';
+        else if (c >= 'A' && c <= 'Z') c = static_cast<unsigned char>(c - 'A' + 'a');
+        normalized += static_cast<char>(c);
+    }
+    std::vector<uint32_t> keys;
+    for (size_t i = 0; i + 3 <= normalized.size(); ++i) {
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(normalized.data() + i);
+        // Runs of separators say nothing about the text
+        if (p[1] == ' ' && (p[0] == ' ' || p[2] == ' ')) continue;
+        keys.push_back((static_cast<uint32_t>(p[0]) << 16) | (static_cast<uint32_t>(p[1]) << 8) | p[2]);
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
+
+void TrigramIndex::add(int id, std::string_view description) {
+    std::vector<uint32_t> keys = trigrams(description, true);
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    for (uint32_t key : keys) lists_[key].insert(id);
+}
+
+void TrigramIndex::remove(int id, std::string_view description) {
+    std::vector<uint32_t> keys = trigrams(description, true);
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    for (uint32_t key : keys) {
+        auto entry = lists_.find(key);
+        if (entry == lists_.end()) continue;
+        entry->second.erase(id);
+        if (entry->second.empty()) lists_.erase(entry);
+    }
+}
+
+// Function to touch only the lists of trigrams that were added or dropped
+void TrigramIndex::update(int id, std::string_view oldDescription, std::string_view newDescription) {
+    std::vector<uint32_t> oldKeys = trigrams(oldDescription, true);
+    std::vector<uint32_t> newKeys = trigrams(newDescription, true);
+    std::vector<uint32_t> dropped;
+    std::vector<uint32_t> added;
+    std::set_difference(oldKeys.begin(), oldKeys.end(), newKeys.begin(), newKeys.end(), std::back_inserter(dropped));
+    std::set_difference(newKeys.begin(), newKeys.end(), oldKeys.begin(), oldKeys.end(), std::back_inserter(added));
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    for (uint32_t key : dropped) {
+        auto entry = lists_.find(key);
+        if (entry == lists_.end()) continue;
+        entry->second.erase(id);
+        if (entry->second.empty()) lists_.erase(entry);
+    }
+    for (uint32_t key : added) lists_[key].insert(id);
+}
+
+void TrigramIndex::clear() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    lists_.clear();
+}
+
+bool TrigramIndex::candidates(std::string_view pattern, bool prefix, std::vector<int>& ids) const {
+    std::vector<uint32_t> keys = trigrams(pattern, prefix);
+    if (keys.empty()) return false;
+
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    std::vector<const PostingList*> lists;
+    for (uint32_t key : keys) {
+        auto entry = lists_.find(key);
+        // No task has this trigram, so none can match
+        if (entry == lists_.end()) return true;
+        lists.push_back(&entry->second);
+    }
+    // Start from the shortest list so every later step has the fewest candidates
+    std::sort(lists.begin(), lists.end(), [](const auto* a, const auto* b) { return a->size() < b->size(); });
+    lists[0]->decode(ids);
+    for (size_t i = 1; i < lists.size() && !ids.empty(); ++i) {
+        lists[i]->intersect(ids);
+    }
+    return true;
+}
+
+bool TrigramIndex::matches(std::string_view description, std::string_view pattern, bool prefix) {
+    auto lower = [](char ch) { return (ch >= 'A' && ch <= 'Z') ? static_cast<char>(ch - 'A' + 'a') : ch; };
+    if (pattern.size() > description.size()) return false;
+    for (size_t pos = 0; pos + pattern.size() <= description.size(); ++pos) {
+        if (prefix && pos > 0 && isWordByte(static_cast<unsigned char>(description[pos - 1]))) continue;
+        size_t i = 0;
+        while (i < pattern.size() && lower(description[pos + i]) == lower(pattern[i])) ++i;
+        if (i == pattern.size()) return true;
+    }
+    return false;
+}
+
+size_t TrigramIndex::trigramCount() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return lists_.size();
+}
+
+size_t TrigramIndex::memoryUsage() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    size_t total = lists_.bucket_count() * sizeof(void*);
+    for (const auto& [key, list] : lists_) {
+        total += sizeof(std::pair<const uint32_t, PostingList>) + sizeof(void*) + list.memoryUsage();
+    }
+    return total;
+}
@@ -0,0 +1,118 @@
+﻿#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include <cstdint>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Inverted index from the words of task descriptions to the tasks using them.
+// Every word maps to a posting list of task IDs kept sorted, so queries are
+// answered by intersecting and merging lists instead of scanning every task.
+// New tasks get the highest ID so far, which makes adding one an append to
+// each of its lists. Queries run under a shared lock, changes under an
+// exclusive one.
+class SearchIndex {
+public:
+    // Splits text into lowercase words of letters and digits; bytes of
+    // multi-byte UTF-8 characters count as letters
+    static std::vector<std::string> tokenize(std::string_view text);
+
+    void add(int id, std::string_view description);
+    void remove(int id, std::string_view description);
+    // Moves a task from the words of its old description to those of the new one
+    void update(int id, std::string_view oldDescription, std::string_view newDescription);
+    void clear();
+
+    // IDs of matching tasks in ascending order. Words are ANDed, and the
+    // keyword OR separates alternatives: "milk eggs OR bread" finds tasks
+    // mentioning both milk and eggs, or bread.
+    std::vector<int> search(std::string_view query) const;
+
+    size_t wordCount() const;
+    // Heap bytes held by the posting lists
+    size_t memoryUsage() const;
+
+private:
+    // Adds or removes one task on the lists of a set of distinct words; mutex_ must be held
+    void addWords(int id, const std::vector<std::string>& words);
+    void removeWords(int id, const std::vector<std::string>& words);
+
+    std::unordered_map<std::string, std::vector<int>> postings_;
+    mutable std::shared_mutex mutex_;
+};
+
+// Index of the three-byte sequences (trigrams) of task descriptions, for
+// substring and word-prefix search. Descriptions are lowercased and every
+// byte that is not part of a word becomes a space, with one more space in
+// front, so " ab" marks a word starting with "ab". A query looks up the
+// trigrams of its pattern and only the tasks on all of those lists are
+// candidates; the caller confirms each one with matches().
+// Posting lists are delta/varint compressed in blocks of up to BLOCK_IDS
+// IDs, so a change decodes one small block and intersections skip over
+// blocks that cannot hold a candidate.
+class TrigramIndex {
+public:
+    void add(int id, std::string_view description);
+    void remove(int id, std::string_view description);
+    // Moves a task from the trigrams of its old description to those of the new one
+    void update(int id, std::string_view oldDescription, std::string_view newDescription);
+    void clear();
+
+    // Collects the sorted IDs of tasks that may contain pattern or, with
+    // prefix, a word starting with it. Returns false if the pattern is too
+    // short to narrow anything down, in which case every task is a candidate.
+    bool candidates(std::string_view pattern, bool prefix, std::vector<int>& ids) const;
+    // Case-insensitive check of a candidate's description
+    static bool matches(std::string_view description, std::string_view pattern, bool prefix);
+
+    size_t trigramCount() const;
+    // Heap bytes held by the posting lists
+    size_t memoryUsage() const;
+
+private:
+    // Sorted task IDs, compressed in blocks
+    class PostingList {
+    public:
+        void insert(int id);
+        void erase(int id);
+        bool empty() const { return blocks_.empty(); }
+        size_t size() const { return size_; }
+        // Appends every ID to ids
+        void decode(std::vector<int>& ids) const;
+        // Drops the IDs of a sorted vector that are not in this list
+        void intersect(std::vector<int>& ids) const;
+        size_t memoryUsage() const;
+
+    private:
+        static const size_t BLOCK_IDS = 128;
+
+        // IDs first..last; bytes holds the gaps after first as varints
+        struct Block {
+            int first = 0;
+            int last = 0;
+            uint32_t count = 0;
+            std::string bytes;
+        };
+
+        static void decodeBlock(const Block& block, std::vector<int>& ids);
+        static Block encodeBlock(const int* ids, size_t count);
+        // Last block whose first ID is not above id, or 0
+        size_t blockFor(int id) const;
+        // Replaces block index with the given IDs, splitting or dropping it as needed
+        void rewriteBlock(size_t index, const std::vector<int>& ids);
+
+        std::vector<Block> blocks_;
+        size_t size_ = 0;
+    };
+
+    // Distinct trigram keys of a normalized text
+    static std::vector<uint32_t> trigrams(std::string_view text, bool wordStart);
+
+    std::unordered_map<uint32_t, PostingList> lists_;
+    mutable std::shared_mutex mutex_;
+};
+
+#endif // SEARCH_INDEX_H
@@ -1,44 +1,438 @@
 ﻿#include "Server.h"
+#include "EventLoopServer.h"
+#include "Listener.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "ResponseCache.h"
+#include "SearchIndex.h"
+#include "TaskLog.h"
+#include "TaskSnapshot.h"
+#include "TaskStore.h"
+#include "Task.h"
+#include "WireFormat.h"
+#include "WorkStealingQueue.h"
 #include "httplib.h"
 #include "json.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 #include <iostream>
 
 // Using the nlohmann::json library for JSON handling
 using json = nlohmann::json;
 
-// A global map to store tasks with unique task IDs as keys
-std::unordered_map<int, json> tasks;
-// Counter to generate unique task IDs
-int nextTaskId = 1;
+// A global store holding every task, sharded by task ID so handlers can run concurrently
+ConcurrentTaskStore tasks;
 
-// Function to save all tasks to a JSON file
-void saveTasksToFile() {
+// File holding the full task list
+const std::string TASKS_FILE_PATH = "C:\\Users\\chouse\\Desktop\\UNI\\fourth year\\C++\\TaskManagerProject\\server\\tasks.json";
+// Binary snapshot written by the compactor, preferred over tasks.json at startup
+const std::string TASKS_SNAPSHOT_PATH = "C:\\Users\\chouse\\Desktop\\UNI\\fourth year\\C++\\TaskManagerProject\\server\\tasks.snap";
+// Write-ahead log of mutations made since the last snapshot was written
+const std::string TASKS_LOG_PATH = "C:\\Users\\chouse\\Desktop\\UNI\\fourth year\\C++\\TaskManagerProject\\server\\tasks.log";
+
+// Log that every POST/PUT/DELETE is appended to instead of rewriting tasks.json
+TaskLog taskLog(TASKS_LOG_PATH);
+// Serialized GET /tasks body for the latest store version, one cache per wire format
+ResponseCache tasksResponseCaches[3];
+// Word index over task descriptions behind GET /tasks/search?q=
+SearchIndex searchIndex;
+// Trigram index behind GET /tasks/search?contains= and ?prefix=
+TrigramIndex trigramIndex;
+// Executor running connections in epoll mode, for GET /stats; null with httplib's pool
+std::atomic<WorkStealingQueue*> executor{ nullptr };
+// A listening socket of threads mode and the executor running its connections
+struct ListenerInstance {
+    explicit ListenerInstance(int backlog) : server(backlog) {}
+    Listener server;
+    // Null with httplib's pool
+    std::atomic<WorkStealingQueue*> executor{ nullptr };
+};
+// Listeners of threads mode, for GET /stats; filled before the server starts listening
+std::vector<std::unique_ptr<ListenerInstance>> listeners;
+#ifdef __linux__
+// Server running in epoll mode, for GET /stats; null in threads mode
+std::atomic<EventLoopServer*> eventLoopServer{ nullptr };
+#endif
+// Routes counted by GET /metrics as method and path pattern; any other request counts as the last one
+const std::pair<const char*, const char*> METRIC_ROUTES[] = {
+    { "GET", "/tasks" }, { "POST", "/tasks" }, { "GET", "/tasks/events" }, { "POST", "/tasks/batch" },
+    { "GET", "/tasks/export" }, { "POST", "/tasks/import" }, { "GET", "/tasks/search" },
+    { "GET", "/tasks/{id}" }, { "PUT", "/tasks/{id}" }, { "DELETE", "/tasks/{id}" },
+    { "GET", "/stats" }, { "GET", "/metrics" }, { "other", "other" },
+};
+const size_t METRIC_ROUTE_COUNT = sizeof(METRIC_ROUTES) / sizeof(METRIC_ROUTES[0]);
+// Request counts and latencies per route, recorded by every server instance
+RequestMetrics requestMetrics(METRIC_ROUTE_COUNT);
+// When the request being handled on this thread reached routing, cleared once it is recorded
+thread_local std::chrono::steady_clock::time_point requestStart;
+// Distinguishes this server run in ETags, store versions restart at 0 on every startup
+const std::string SERVER_EPOCH = std::to_string(
+    std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+
+// Function to apply a mutation to a task store (or a chunk of one)
+template <typename Store>
+void applyMutation(Store& store, const TaskMutation& mutation) {
+    switch (mutation.type) {
+    case MutationType::Create:
+    case MutationType::Update:
+        store.put(mutation.id, mutation.description);
+        break;
+    case MutationType::Delete:
+        store.erase(mutation.id);
+        break;
+    }
+}
+
+// Function to keep the search indexes in step with a mutation; oldDescription
+// is the task's description before it (empty for a new task)
+void indexMutation(const TaskMutation& mutation, const std::string& oldDescription) {
+    if (mutation.type == MutationType::Delete) {
+        searchIndex.remove(mutation.id, oldDescription);
+        trigramIndex.remove(mutation.id, oldDescription);
+    }
+    else {
+        searchIndex.update(mutation.id, oldDescription, mutation.description);
+        trigramIndex.update(mutation.id, oldDescription, mutation.description);
+    }
+}
+
+// Function to apply a mutation to the store and queue its log record.
+// The record is submitted while the new store version is being published,
+// so log order always matches version order; the caller then waits on the
+// returned sequence. The search index is updated at the same point.
+// Returns false if an updated or deleted task does not exist.
+bool stageMutation(const TaskMutation& mutation, uint64_t& sequence) {
+    std::string oldDescription;
+    return tasks.write(mutation.id, [&](TaskStore& chunk) {
+        if (mutation.type != MutationType::Create && !chunk.contains(mutation.id)) return false;
+        oldDescription.assign(chunk.description(mutation.id));
+        applyMutation(chunk, mutation);
+        return true;
+        }, [&] {
+            sequence = taskLog.submit(mutation);
+            indexMutation(mutation, oldDescription);
+        });
+}
+
+// Largest number of operations accepted by POST /tasks/batch
+const size_t MAX_BATCH_OPERATIONS = 10000;
+
+// Function to apply a list of mutations as one store version.
+// Every stripe is locked once for the whole batch and all log records are
+// submitted back to back, so they share a single group commit; sequence is
+// the last of them. status[i] is set to 200, or 404 if mutation i updates or
+// deletes a task that does not exist (such mutations are skipped).
+void stageMutationBatch(const std::vector<TaskMutation>& mutations, std::vector<int>& status, uint64_t& sequence) {
+    std::vector<std::string> oldDescriptions(mutations.size());
+    status.assign(mutations.size(), 404);
+    tasks.writeBatch([&](TaskBatch& batch) {
+        for (size_t i = 0; i < mutations.size(); ++i) {
+            const TaskMutation& mutation = mutations[i];
+            if (mutation.type != MutationType::Create && !batch.contains(mutation.id)) continue;
+            oldDescriptions[i].assign(batch.description(mutation.id));
+            applyMutation(batch, mutation);
+            status[i] = 200;
+        }
+        return true;
+        }, [&] {
+            for (size_t i = 0; i < mutations.size(); ++i) {
+                if (status[i] != 200) continue;
+                sequence = taskLog.submit(mutations[i]);
+                indexMutation(mutations[i], oldDescriptions[i]);
+            }
+        });
+}
+
+// Function to wait until a staged mutation is on disk.
+// A false return is answered with 500, but the change has already been
+// published and stays visible to readers until a restart replays the log
+// without it; see rejectIfLogFailed() for how later writes are kept out.
+bool waitForMutation(uint64_t sequence) {
+    if (!taskLog.waitDurable(sequence)) {
+        LOG_ERROR("Could not append to the log", { { "path", taskLog.path() } });
+        return false;
+    }
+    return true;
+}
+
+// Function to answer a write with 503 once the log has failed.
+// Changes reach the store before they are durable and are never rolled
+// back, so after a failed batch every further write would be reported as
+// failed yet still be seen by readers. Refusing them before they are
+// applied keeps the store at what the log holds, up to the writes that
+// were in flight when the batch failed.
+bool rejectIfLogFailed(httplib::Response& res) {
+    if (!taskLog.failed()) return false;
+    res.status = 503;
+    res.set_content("Changes cannot be saved, the log could not be written", "text/plain");
+    return true;
+}
+
+// Lines applied per store version by POST /tasks/import
+const size_t IMPORT_BATCH_LINES = 1000;
+// Longest NDJSON line accepted, longer ones are rejected without being buffered
+const size_t MAX_IMPORT_LINE_BYTES = 1024 * 1024;
+// How far past the next free ID an imported task's ID may be. Every ID up to
+// the highest one costs room in the task set's group list, which is copied
+// on each write, so a stray huge ID would slow down every later change.
+const int MAX_IMPORT_ID_GAP = 1 << 20;
+// Rejected lines reported back in detail, the rest are only counted
+const size_t MAX_REPORTED_REJECTS = 100;
+
+// Streaming importer for newline-delimited JSON, one task per line:
+// {"description": "..."} gets a new ID, {"id": 7, "description": "..."}
+// keeps its ID and replaces any task already using it.
+// Input arrives in arbitrary pieces; only the current partial line and one
+// batch of mutations are held in memory. Each batch is staged as a single
+// store version, and the importer only waits for a batch to be durable
+// right before staging the next one, so parsing overlaps the disk flush.
+class TaskImporter {
+public:
+    // Function to consume the next piece of the request body
+    bool feed(const char* data, size_t length) {
+        size_t pos = 0;
+        while (pos < length) {
+            const char* newline = static_cast<const char*>(std::memchr(data + pos, '\n', length - pos));
+            size_t end = newline ? static_cast<size_t>(newline - data) : length;
+            if (!skipping_) {
+                if (line_.size() + (end - pos) > MAX_IMPORT_LINE_BYTES) {
+                    reject("line longer than " + std::to_string(MAX_IMPORT_LINE_BYTES) + " bytes");
+                    line_.clear();
+                    skipping_ = true;
+                }
+                else {
+                    line_.append(data + pos, end - pos);
+                }
+            }
+            if (!newline) break;
+            if (!skipping_) parseLine();
+            skipping_ = false;
+            line_.clear();
+            ++lineNumber_;
+            pos = end + 1;
+            if (mutations_.size() >= IMPORT_BATCH_LINES && !flush()) return false;
+        }
+        return true;
+    }
+
+    // Function to handle a last line without a newline and stage what is left
+    bool finish() {
+        if (!skipping_ && !line_.empty()) parseLine();
+        line_.clear();
+        return flush() && (lastSequence_ == 0 || waitForMutation(lastSequence_));
+    }
+
+    // Function to summarize the import as JSON
+    json report(double seconds) const {
+        json jReport;
+        jReport["imported"] = imported_;
+        jReport["rejected"] = rejected_;
+        jReport["rejected_lines"] = rejectedLines_;
+        jReport["seconds"] = seconds;
+        jReport["tasks_per_second"] = seconds > 0 ? imported_ / seconds : 0.0;
+        return jReport;
+    }
+
+private:
+    // Function to turn the buffered line into a mutation, or record why it can't be
+    void parseLine() {
+        if (!line_.empty() && line_.back() == '\r') line_.pop_back();
+        if (line_.find_first_not_of(" \t") == std::string::npos) return;
+        try {
+            json jTask = json::parse(line_);
+            TaskMutation mutation{ MutationType::Create, 0, jTask.at("description").get<std::string>() };
+            if (jTask.contains("id")) {
+                mutation.id = jTask["id"].get<int>();
+                if (mutation.id <= 0) throw std::invalid_argument("id must be positive");
+                if (mutation.id - MAX_IMPORT_ID_GAP >= tasks.nextId()) {
+                    throw std::out_of_range("id more than " + std::to_string(MAX_IMPORT_ID_GAP) + " past the next free ID");
+                }
+                tasks.reserveId(mutation.id);
+            }
+            else {
+                mutation.id = tasks.allocateId();
+            }
+            mutations_.push_back(std::move(mutation));
+        }
+        catch (const std::exception& e) {
+            reject(e.what());
+        }
+    }
+
+    void reject(const std::string& reason) {
+        ++rejected_;
+        if (rejectedLines_.size() < MAX_REPORTED_REJECTS) {
+            rejectedLines_.push_back({ {"line", lineNumber_}, {"error", reason} });
+        }
+    }
+
+    // Function to stage the collected mutations as one batch
+    bool flush() {
+        if (mutations_.empty()) return true;
+        // Keep at most one batch in flight to bound the log's queue
+        if (lastSequence_ != 0 && !waitForMutation(lastSequence_)) return false;
+        // The log may have failed on another request's batch since the import started
+        if (taskLog.failed()) return false;
+        std::vector<int> status;
+        stageMutationBatch(mutations_, status, lastSequence_);
+        imported_ += mutations_.size();
+        mutations_.clear();
+        return true;
+    }
+
+    std::string line_;
+    bool skipping_ = false;
+    size_t lineNumber_ = 1;
+    std::vector<TaskMutation> mutations_;
+    uint64_t lastSequence_ = 0;
+    size_t imported_ = 0;
+    size_t rejected_ = 0;
+    json rejectedLines_ = json::array();
+};
+
+// Function to write a copy of the task map to tasks.json.
+// The data goes to a temporary file first and is renamed over tasks.json
+// once synced, so a crash never leaves a half-written task list behind.
+bool writeTasksFile(const TaskSet& snapshot) {
     // Define the file path to save tasks
-    std::string path = "C:\\Users\\chouse\\Desktop\\UNI\\fourth year\\C++\\TaskManagerProject\\server\\tasks.json";
-    std::ofstream file(path);
+    const std::string& path = TASKS_FILE_PATH;
+    std::string tempPath = path + ".tmp";
+    std::FILE* file = std::fopen(tempPath.c_str(), "wb");
 
-    if (file.is_open()) {
+    if (file) {
         // Convert the tasks map to JSON format
-        json jTasks;
-        for (const auto& [id, task] : tasks) {
-            jTasks[std::to_string(id)] = task;
-        }
+        json jTasks = json::object();
+        snapshot.forEach([&](int id, std::string_view description) {
+            jTasks[std::to_string(id)] = Task{ id, std::string(description) }.to_json();
+            });
         // Write JSON to the file with pretty formatting
-        file << jTasks.dump(4);
-        std::cout << "Tasks saved to file successfully at: " << path << std::endl;
+        std::string data = jTasks.dump(4);
+        bool ok = std::fwrite(data.data(), 1, data.size(), file) == data.size() && syncFile(file);
+        std::fclose(file);
+
+        std::error_code ec;
+        if (ok) std::filesystem::rename(tempPath, path, ec);
+        if (!ok || ec) {
+            LOG_ERROR("Could not write tasks.json", { { "path", path } });
+            std::filesystem::remove(tempPath, ec);
+            return false;
+        }
+        // The rename only counts once the directory entry is on disk
+        if (!syncDirectory(path)) {
+            LOG_ERROR("Could not sync the tasks.json directory", { { "path", path } });
+            return false;
+        }
+        LOG_INFO("Tasks saved to file", { { "path", path } });
+        return true;
     }
     else {
         // Log an error if the file could not be opened
-        std::cerr << "Error: Could not open tasks.json for writing at: " << path << std::endl;
+        LOG_ERROR("Could not open tasks.json for writing", { { "path", tempPath } });
+        return false;
     }
 }
 
-// Function to load tasks from a JSON file
-void loadTasksFromFile() {
+// Function to save all tasks to a JSON file
+void saveTasksToFile() {
+    writeTasksFile(*tasks.snapshot());
+}
+
+// Function to fold the log into a new snapshot and drop the covered segments.
+// The segments and tasks.json are only removed once writeTaskSnapshot() has
+// synced the snapshot and the directory entry renaming it into place.
+bool compactTasks() {
+    LogRotation rotation;
+    TaskSetPtr current;
+    // Grab the store version at the exact point where the log switches segments
+    tasks.withPublishLocked([&](TaskSetPtr snapshot) {
+        rotation = taskLog.rotate();
+        current = std::move(snapshot);
+        });
+    // The version is immutable, so it is copied and written without blocking anyone
+    std::vector<std::pair<int, std::string>> snapshot;
+    snapshot.reserve(current->size());
+    current->forEach([&](int id, std::string_view description) {
+        snapshot.emplace_back(id, description);
+        });
+    current.reset();
+    if (!writeTaskSnapshot(TASKS_SNAPSHOT_PATH, std::move(snapshot))) {
+        return false;
+    }
+    taskLog.removeSealed(rotation);
+    // The snapshot supersedes tasks.json, don't leave a stale copy behind
+    std::error_code ec;
+    std::filesystem::remove(TASKS_FILE_PATH, ec);
+    return true;
+}
+
+// Background thread that compacts the log once it has grown large enough
+class Compactor {
+public:
+    void start(std::chrono::seconds interval, uint64_t minLogBytes) {
+        if (interval.count() <= 0) return;
+        thread_ = std::thread([this, interval, minLogBytes] {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (!cv_.wait_for(lock, interval, [this] { return stopping_; })) {
+                if (taskLog.activeSegmentBytes() < minLogBytes) continue;
+                lock.unlock();
+                compactTasks();
+                lock.lock();
+            }
+            });
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        if (thread_.joinable()) thread_.join();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+    std::thread thread_;
+};
+
+// Function to load tasks from the binary snapshot, returns false if there is none.
+// A snapshot that exists but cannot be read stops startup: compaction has
+// already removed tasks.json and the log segments it covers, so starting
+// without it would silently lose every task it holds.
+bool loadTasksFromSnapshot(TaskSetBuilder& builder) {
+    if (!std::filesystem::exists(TASKS_SNAPSHOT_PATH)) return false;
+    TaskSnapshot snapshot;
+    std::string error;
+    if (!snapshot.open(TASKS_SNAPSHOT_PATH, error)) {
+        throw std::runtime_error("Could not read snapshot " + TASKS_SNAPSHOT_PATH + ": " + error);
+    }
+    // Descriptions are copied straight from the mapping into the store's arena
+    for (size_t i = 0; i < snapshot.size(); ++i) {
+        int id = snapshot.idAt(i);
+        builder.put(id, snapshot.descriptionAt(i));
+        tasks.reserveId(id);
+    }
+    LOG_INFO("Tasks loaded from snapshot", { { "tasks", snapshot.size() } });
+    return true;
+}
+
+// Function to load tasks from tasks.json
+void loadTasksFromJsonFile(TaskSetBuilder& builder) {
     // Use the same path as in saveTasksToFile()
-    std::string path = "C:\\Users\\chouse\\Desktop\\UNI\\fourth year\\C++\\TaskManagerProject\\server\\tasks.json";
+    const std::string& path = TASKS_FILE_PATH;
     std::ifstream file(path);
 
     if (file.is_open()) {
@@ -48,85 +442,673 @@ void loadTasksFromFile() {
             file >> jTasks;
             for (const auto& [key, value] : jTasks.items()) {
                 int id = std::stoi(key); // Convert the string key to an integer
-                tasks[id] = value;      // Add the task to the map
-                // Ensure the nextTaskId is updated to avoid ID conflicts
-                nextTaskId = std::max(nextTaskId, id + 1);
+                std::string description = value.value("description", std::string());
+                builder.put(id, description); // Add the task to the store
+                // Ensure the next task ID is updated to avoid ID conflicts
+                tasks.reserveId(id);
             }
-            std::cout << "Tasks loaded from file successfully!" << std::endl;
+            LOG_INFO("Tasks loaded from file", { { "path", path } });
         }
         catch (...) {
             // Handle any errors during JSON parsing
-            std::cerr << "Error: Failed to parse tasks.json. Starting with an empty task list." << std::endl;
+            LOG_ERROR("Failed to parse tasks.json, starting with an empty task list", { { "path", path } });
         }
     }
     else {
         // If the file is not found, create a new empty file
-        std::cerr << "tasks.json not found. Creating a new one." << std::endl;
+        LOG_WARN("tasks.json not found, creating a new one", { { "path", path } });
         saveTasksToFile();
     }
 }
 
+// Function to load tasks from the latest snapshot plus the log
+void loadTasksFromFile() {
+    // Collect everything first and publish it as the store's first version
+    TaskSetBuilder builder;
+
+    // Prefer the binary snapshot, tasks.json is only read until the first compaction
+    if (!loadTasksFromSnapshot(builder)) {
+        loadTasksFromJsonFile(builder);
+    }
+
+    // Replay mutations logged after the snapshot was last written
+    size_t replayed = taskLog.replay([&](const TaskMutation& mutation) {
+        applyMutation(builder, mutation);
+        // Ensure IDs seen in the log are never handed out again
+        tasks.reserveId(mutation.id);
+        });
+    if (replayed > 0) {
+        LOG_INFO("Replayed logged changes", { { "changes", replayed }, { "path", taskLog.path() } });
+    }
+    tasks.reset(builder.build());
+
+    // Index the loaded tasks for search
+    searchIndex.clear();
+    trigramIndex.clear();
+    tasks.snapshot()->forEach([](int id, std::string_view description) {
+        searchIndex.add(id, description);
+        trigramIndex.add(id, description);
+        });
+}
+
+// Function to convert a store version to the {"<id>": task} document in a wire format
+std::string serializeTasks(const TaskSet& snapshot, WireFormat format) {
+    json jTasks = json::object();
+    snapshot.forEach([&](int id, std::string_view description) {
+        jTasks[std::to_string(id)] = Task{ id, std::string(description) }.to_json();
+        });
+    return encodeWire(jTasks, format);
+}
+
+// Function to send a document in the format the client asked for in its Accept header
+void sendDocument(const httplib::Request& req, httplib::Response& res, const json& document) {
+    WireFormat format = negotiateWireFormat(req.get_header_value("Accept"));
+    res.set_header("Vary", "Accept");
+    res.set_content(encodeWire(document, format), wireFormatContentType(format));
+}
+
+// Function to parse a request body in the format named by its Content-Type
+json parseRequestBody(const httplib::Request& req) {
+    return decodeWire(req.body, wireFormatFromContentType(req.get_header_value("Content-Type")));
+}
+
 // Function to handle updating a specific task by ID
 void handleUpdateTask(const httplib::Request& req, httplib::Response& res) {
     // Extract the task ID from the URL
     std::string taskIdStr = req.matches[1];
     int taskId = std::stoi(taskIdStr);
 
-    std::cout << "📥 Received update request for Task ID: " << taskId << std::endl;
+    LOG_DEBUG("Received update request", { { "id", taskId } });
 
     // Parse the JSON body of the request
-    json taskJson = json::parse(req.body);
-    std::cout << "📜 Received JSON: " << taskJson.dump() << std::endl;
-
-    // Check if the task exists in the map
-    if (tasks.find(taskId) != tasks.end()) {
-        // Update the task description
-        tasks[taskId]["description"] = taskJson["description"];
-        // Save the updated tasks to the file
-        saveTasksToFile();
+    json taskJson = parseRequestBody(req);
+    LOG_DEBUG("Received task", { { "id", taskId }, { "body", taskJson.dump() } });
+
+    if (!taskJson.contains("description") || !taskJson["description"].is_string()) {
+        res.status = 400;
+        res.set_content("Missing task description", "text/plain");
+        return;
+    }
+
+    if (rejectIfLogFailed(res)) return;
+
+    // Update the task if it exists and queue the change for the log
+    Task updated{ taskId, taskJson["description"].get<std::string>() };
+    uint64_t sequence = 0;
+    if (stageMutation({ MutationType::Update, taskId, updated.description }, sequence)) {
+        // Respond only once the change is durable
+        if (!waitForMutation(sequence)) {
+            res.status = 500;
+            res.set_content("Failed to save task", "text/plain");
+            return;
+        }
         // Respond to the client with success message
         res.set_content("Task updated successfully", "text/plain");
-        std::cout << "✅ Task updated: " << tasks[taskId].dump() << std::endl;
+        LOG_DEBUG("Task updated", { { "id", taskId }, { "description", updated.description } });
     }
     else {
         // Respond with a 404 error if the task is not found
         res.status = 404;
         res.set_content("Task not found", "text/plain");
-        std::cout << "❌ Task ID " << taskId << " not found!" << std::endl;
+        LOG_DEBUG("Task to update not found", { { "id", taskId } });
     }
 }
 
-// Function to start the HTTP server and define routes
-void startServer() {
-    httplib::Server server;
+// Function to build the ETag of a store version
+std::string makeETag(uint64_t version) {
+    return "\"" + SERVER_EPOCH + "-" + std::to_string(version) + "\"";
+}
 
-    // Load tasks from file at server startup
-    loadTasksFromFile();
+// Function to check an If-None-Match header (a list of ETags or *) against an ETag
+bool etagMatches(const std::string& ifNoneMatch, const std::string& etag) {
+    size_t pos = 0;
+    while (pos < ifNoneMatch.size()) {
+        size_t end = ifNoneMatch.find(',', pos);
+        if (end == std::string::npos) end = ifNoneMatch.size();
+        std::string candidate = ifNoneMatch.substr(pos, end - pos);
+        // Trim whitespace and ignore the weak validator prefix
+        size_t first = candidate.find_first_not_of(" \t");
+        size_t last = candidate.find_last_not_of(" \t");
+        candidate = first == std::string::npos ? "" : candidate.substr(first, last - first + 1);
+        if (candidate.rfind("W/", 0) == 0) candidate = candidate.substr(2);
+        if (candidate == "*" || candidate == etag) return true;
+        pos = end + 1;
+    }
+    return false;
+}
+
+// Function to parse a "<epoch>-<version>" sync token, the ETag without its quotes.
+// Returns false if it was issued by another server run or is malformed.
+bool parseSyncToken(const std::string& token, uint64_t& version) {
+    size_t dash = token.rfind('-');
+    if (dash == std::string::npos || token.compare(0, dash, SERVER_EPOCH) != 0 || dash + 1 == token.size()) {
+        return false;
+    }
+    try {
+        size_t used = 0;
+        version = std::stoull(token.substr(dash + 1), &used);
+        return used == token.size() - dash - 1;
+    }
+    catch (...) {
+        return false;
+    }
+}
+
+// Function to build the GET /tasks?since= document.
+// Lists the tasks created or updated after the given version under "changed"
+// and the IDs of deleted ones under "deleted". If the change log no longer
+// reaches back that far, the whole task list is sent with "full": true.
+json taskDeltaToJson(const TaskSet& snapshot, const std::string& since) {
+    json jDelta;
+    jDelta["version"] = SERVER_EPOCH + "-" + std::to_string(snapshot.version());
+    uint64_t sinceVersion = 0;
+    std::vector<int> ids;
+    if (!parseSyncToken(since, sinceVersion) || !tasks.changedSince(sinceVersion, snapshot.version(), ids)) {
+        jDelta["full"] = true;
+        jDelta["tasks"] = json::object();
+        snapshot.forEach([&](int id, std::string_view description) {
+            jDelta["tasks"][std::to_string(id)] = Task{ id, std::string(description) }.to_json();
+            });
+        return jDelta;
+    }
+    jDelta["full"] = false;
+    jDelta["changed"] = json::object();
+    jDelta["deleted"] = json::array();
+    for (int id : ids) {
+        Task task;
+        // A changed task that is gone from this version was deleted
+        if (snapshot.get(id, task)) jDelta["changed"][std::to_string(id)] = task.to_json();
+        else jDelta["deleted"].push_back(id);
+    }
+    return jDelta;
+}
+
+// Longest a GET /tasks/events stream stays silent before a keep-alive comment is sent
+const std::chrono::seconds EVENT_KEEPALIVE_INTERVAL(15);
+// How often an idle stream checks whether its client is still connected
+const std::chrono::seconds EVENT_POLL_INTERVAL(1);
+// GET /tasks/events streams currently open
+std::atomic<size_t> openEventStreams{ 0 };
+
+// Function to format one Server-Sent Event
+std::string formatEvent(const std::string& type, const json& data, const std::string& id = "") {
+    std::string event = "event: " + type + "\ndata: " + data.dump() + "\n";
+    if (!id.empty()) event += "id: " + id + "\n";
+    return event + "\n";
+}
+
+// Function to turn the changes after a version into create/update/delete events.
+// Every task is reported once with its state in the snapshot, in the order of
+// its last change; only the final event carries the snapshot's version as its
+// ID, so a client resuming with Last-Event-ID never skips part of a batch.
+// Returns false if the change log no longer reaches back to the version.
+bool taskEventsSince(const TaskSet& snapshot, uint64_t since, std::string& events) {
+    std::vector<ConcurrentTaskStore::Change> changes;
+    if (!tasks.changesSince(since, snapshot.version(), changes)) return false;
+
+    // A task created and then updated since the version is still new to the client
+    std::unordered_map<int, bool> created;
+    std::vector<int> order;
+    for (auto it = changes.rbegin(); it != changes.rend(); ++it) {
+        auto [entry, added] = created.emplace(it->id, it->created);
+        if (added) order.push_back(it->id);
+        else entry->second = it->created;
+    }
+    std::reverse(order.begin(), order.end());
+
+    std::string version = SERVER_EPOCH + "-" + std::to_string(snapshot.version());
+    for (size_t i = 0; i < order.size(); ++i) {
+        int id = order[i];
+        std::string eventId = i + 1 == order.size() ? version : "";
+        Task task;
+        if (!snapshot.get(id, task)) events += formatEvent("delete", { {"id", id} }, eventId);
+        else events += formatEvent(created[id] ? "create" : "update", task.to_json(), eventId);
+    }
+    return true;
+}
+
+// Function to stream task changes as Server-Sent Events, starting after the
+// given version. The stream opens with a "version" event naming the version it
+// starts from, or a "reset" event if the client asked to resume from a version
+// the change log no longer covers and has to reload its tasks first.
+void streamTaskEvents(httplib::Response& res, const std::string& lastEventId) {
+    struct EventState {
+        uint64_t version;
+        std::string pending;
+    };
+    TaskSetPtr snapshot = tasks.snapshot();
+    auto state = std::make_shared<EventState>(EventState{ snapshot->version(), "retry: 3000\n\n" });
+    uint64_t since = 0;
+    std::string version = SERVER_EPOCH + "-" + std::to_string(snapshot->version());
+    if (lastEventId.empty()) {
+        state->pending += formatEvent("version", { {"version", version} }, version);
+    }
+    else if (!parseSyncToken(lastEventId, since) || !taskEventsSince(*snapshot, since, state->pending)) {
+        state->pending += formatEvent("reset", { {"version", version} }, version);
+    }
+
+    res.set_header("Cache-Control", "no-cache");
+    res.set_chunked_content_provider("text/event-stream",
+        [state](size_t, httplib::DataSink& sink) {
+            auto idleSince = std::chrono::steady_clock::now();
+            while (state->pending.empty()) {
+                TaskSetPtr snapshot = tasks.waitForVersion(state->version, EVENT_POLL_INTERVAL);
+                if (snapshot->version() != state->version) {
+                    if (!taskEventsSince(*snapshot, state->version, state->pending)) {
+                        // This client fell further behind than the change log reaches
+                        std::string version = SERVER_EPOCH + "-" + std::to_string(snapshot->version());
+                        state->pending = formatEvent("reset", { {"version", version} }, version);
+                    }
+                    state->version = snapshot->version();
+                }
+                else if (!sink.is_writable()) {
+                    // Free the worker thread soon after the client disconnects
+                    return false;
+                }
+                else if (std::chrono::steady_clock::now() - idleSince >= EVENT_KEEPALIVE_INTERVAL) {
+                    // Comments are ignored by clients but keep proxies from timing the stream out
+                    state->pending = ": keep-alive\n\n";
+                }
+            }
+            // A false return tells httplib the client went away
+            if (!state->pending.empty() && !sink.write(state->pending.data(), state->pending.size())) return false;
+            state->pending.clear();
+            return true;
+        },
+        [](bool) { --openEventStreams; });
+}
+
+// Page size of GET /tasks when only a cursor is given, and the largest one allowed
+const size_t DEFAULT_PAGE_SIZE = 100;
+const size_t MAX_PAGE_SIZE = 1000;
+
+// Function to encode the ID a page starts at as an opaque cursor
+std::string makeCursor(int id) {
+    char buffer[16];
+    std::snprintf(buffer, sizeof(buffer), "%08x", static_cast<unsigned>(id));
+    return buffer;
+}
+
+// Function to decode a cursor, returns false if it was not made by makeCursor()
+bool parseCursor(const std::string& cursor, int& id) {
+    if (cursor.size() != 8 || cursor.find_first_not_of("0123456789abcdef") != std::string::npos) {
+        return false;
+    }
+    unsigned long value = std::stoul(cursor, nullptr, 16);
+    if (value > static_cast<unsigned long>(INT32_MAX)) return false;
+    id = static_cast<int>(value);
+    return true;
+}
+
+// Function to read an optional limit parameter, capped at MAX_PAGE_SIZE.
+// Leaves limit untouched if absent; returns false if it is not a positive number.
+bool parseLimit(const httplib::Request& req, size_t& limit) {
+    if (!req.has_param("limit")) return true;
+    try {
+        long long requested = std::stoll(req.get_param_value("limit"));
+        if (requested <= 0) return false;
+        limit = std::min<size_t>(static_cast<size_t>(requested), MAX_PAGE_SIZE);
+        return true;
+    }
+    catch (...) {
+        return false;
+    }
+}
+
+// Function to build one page of GET /tasks: up to limit tasks in ID order
+// starting at firstId, plus the cursor of the next page if there is one
+json taskPageToJson(const TaskSet& snapshot, int firstId, size_t limit) {
+    json jPage;
+    jPage["tasks"] = json::object();
+    size_t count = 0;
+    int nextId = -1;
+    snapshot.forEachFrom(firstId, [&](int id, std::string_view description) {
+        if (count == limit) {
+            // One task past the page proves there is a next page
+            nextId = id;
+            return false;
+        }
+        jPage["tasks"][std::to_string(id)] = Task{ id, std::string(description) }.to_json();
+        ++count;
+        return true;
+        });
+    jPage["next_cursor"] = nextId < 0 ? json(nullptr) : json(makeCursor(nextId));
+    return jPage;
+}
+
+// Function to find the tasks containing some text (or, with prefix, a word
+// starting with it). The trigram index narrows the search down to a few
+// candidates; patterns too short for it fall back to checking every task.
+std::vector<int> findSubstring(const TaskSet& snapshot, const std::string& pattern, bool prefix) {
+    std::vector<int> ids;
+    if (trigramIndex.candidates(pattern, prefix, ids)) {
+        // Candidates share the pattern's trigrams, confirm the text itself
+        ids.erase(std::remove_if(ids.begin(), ids.end(), [&](int id) {
+            return !TrigramIndex::matches(snapshot.description(id), pattern, prefix);
+            }), ids.end());
+        return ids;
+    }
+    snapshot.forEach([&](int id, std::string_view description) {
+        if (TrigramIndex::matches(description, pattern, prefix)) ids.push_back(id);
+        });
+    return ids;
+}
+
+// Tasks serialized per chunk of a streamed export
+const size_t EXPORT_CHUNK_TASKS = 1000;
+
+// Function to stream every task of a store version as NDJSON or a JSON array.
+// The response is sent with chunked transfer encoding; each call of the
+// content provider serializes the next EXPORT_CHUNK_TASKS tasks, so only one
+// chunk is ever held in memory and the client can parse as it receives.
+void streamTaskExport(httplib::Response& res, TaskSetPtr snapshot, bool ndjson) {
+    struct ExportState {
+        TaskSetPtr snapshot;
+        bool ndjson;
+        // ID the next chunk starts at
+        int nextId = 0;
+        bool first = true;
+    };
+    auto state = std::make_shared<ExportState>(ExportState{ std::move(snapshot), ndjson });
+    res.set_chunked_content_provider(ndjson ? "application/x-ndjson" : "application/json",
+        [state](size_t, httplib::DataSink& sink) {
+            std::string chunk;
+            if (state->first && !state->ndjson) chunk += '[';
+            size_t count = 0;
+            int resumeAt = -1;
+            state->snapshot->forEachFrom(state->nextId, [&](int id, std::string_view description) {
+                if (count == EXPORT_CHUNK_TASKS) {
+                    resumeAt = id;
+                    return false;
+                }
+                if (!state->ndjson && !state->first) chunk += ',';
+                chunk += Task{ id, std::string(description) }.to_json().dump();
+                if (state->ndjson) chunk += '\n';
+                state->first = false;
+                ++count;
+                return true;
+                });
+            state->nextId = resumeAt;
+            if (resumeAt < 0 && !state->ndjson) chunk += ']';
+            // A false return tells httplib the client went away. Empty writes
+            // are skipped since httplib takes them as the end of the data.
+            if (!chunk.empty() && !sink.write(chunk.data(), chunk.size())) return false;
+            if (resumeAt < 0) sink.done();
+            return true;
+        });
+}
+
+// Bodies smaller than this are sent uncompressed, the saving isn't worth the CPU
+const size_t COMPRESS_MIN_BYTES = 1024;
+
+// Function to send a cached body, compressed if the client accepts it.
+// The compressed copy is kept with the cached body, so a version is only
+// compressed once however many clients fetch it. For JSON, the charset
+// parameter keeps httplib from compressing the body a second time on its own.
+void sendCached(const httplib::Request& req, httplib::Response& res, const CachedResponse& cached, WireFormat format) {
+    res.set_header("Vary", "Accept, Accept-Encoding");
+    ContentCoding coding = cached.body.size() >= COMPRESS_MIN_BYTES
+        ? negotiateContentCoding(req.get_header_value("Accept-Encoding")) : ContentCoding::Identity;
+    const std::string* body = cached.encoded(coding);
+    if (coding != ContentCoding::Identity && body) {
+        res.set_header("Content-Encoding", contentCodingName(coding));
+    }
+    else {
+        body = &cached.body;
+    }
+    res.set_content(*body, format == WireFormat::Json ? "application/json; charset=utf-8" : wireFormatContentType(format));
+}
+
+// Function to answer 304 Not Modified if the client already has this version.
+// Sets the ETag header either way; returns true if the response is complete.
+bool respondNotModified(const httplib::Request& req, httplib::Response& res, uint64_t version) {
+    std::string etag = makeETag(version);
+    res.set_header("ETag", etag);
+    if (req.has_header("If-None-Match") && etagMatches(req.get_header_value("If-None-Match"), etag)) {
+        res.status = 304;
+        return true;
+    }
+    return false;
+}
+
+// Function to describe the write-ahead log batching as JSON
+json logStatsToJson(const GroupCommitStats& stats) {
+    json jStats;
+    jStats["batches"] = stats.batches;
+    jStats["records"] = stats.records;
+    jStats["bytes"] = stats.bytes;
+    jStats["largest_batch"] = stats.largestBatch;
+    jStats["failed_batches"] = stats.failedBatches;
+    jStats["avg_batch_records"] = stats.batches ? double(stats.records) / stats.batches : 0.0;
+    // Histogram buckets are powers of two: 1, 2-3, 4-7, ...
+    json histogram = json::object();
+    for (size_t i = 0; i < GroupCommitStats::BUCKETS; ++i) {
+        uint64_t low = uint64_t(1) << i;
+        std::string label = (i + 1 == GroupCommitStats::BUCKETS) ? std::to_string(low) + "+"
+            : (low == 1 ? "1" : std::to_string(low) + "-" + std::to_string(2 * low - 1));
+        histogram[label] = stats.batchSizeHistogram[i];
+    }
+    jStats["batch_size_histogram"] = histogram;
+    return jStats;
+}
+
+// Function to describe the executor's queues as JSON
+json executorStatsToJson(const ExecutorStats& stats) {
+    json jStats;
+    jStats["workers"] = stats.workers;
+    jStats["queued"] = stats.queued;
+    jStats["max_queued"] = stats.maxQueued;
+    jStats["enqueued"] = stats.enqueued;
+    jStats["stolen"] = stats.stolen;
+    jStats["queue_depths"] = stats.depths;
+    return jStats;
+}
+
+// Function to describe a listening socket as JSON
+json listenerStatsToJson(const ListenerStats& stats) {
+    json jStats;
+    jStats["backlog"] = stats.backlog;
+    jStats["accepted"] = stats.accepted;
+    jStats["accepts_per_second"] = stats.acceptsPerSecond;
+    jStats["rejected"] = stats.rejected;
+    jStats["pending"] = stats.pending;
+    return jStats;
+}
+
+// Function to describe the epoll mode's connections as JSON
+json eventLoopStatsToJson(const EventLoopStats& stats) {
+    json jStats;
+    jStats["loops"] = stats.loops;
+    jStats["connections"] = stats.connections;
+    jStats["active_connections"] = stats.activeConnections;
+    jStats["accepted"] = stats.accepted;
+    jStats["requests"] = stats.requests;
+    jStats["idle_timeouts"] = stats.idleTimeouts;
+    return jStats;
+}
+
+// Function to build the new_task_queue factory chosen by --executor. A
+// work-stealing queue is published through queue while it runs, for GET /stats
+std::function<httplib::TaskQueue*()> executorFactory(const ServerConfig& config, std::atomic<WorkStealingQueue*>& queue) {
+    size_t workers = config.workers ? config.workers : CPPHTTPLIB_THREAD_POOL_COUNT;
+    if (config.executor == "stealing") {
+        // httplib creates the queue when listen() starts and deletes it when it returns
+        return [workers, &queue] {
+            auto stealing = new WorkStealingQueue(workers);
+            queue = stealing;
+            return stealing;
+        };
+    }
+    if (config.executor == "pool") {
+        return [workers] { return new httplib::ThreadPool(workers); };
+    }
+    throw std::invalid_argument("Unknown executor: " + config.executor);
+}
+
+// Function to find the METRIC_ROUTES entry a request belongs to
+size_t metricRoute(const std::string& method, const std::string& path) {
+    // Every /tasks/<id> counts as one route
+    const char* pattern = path.c_str();
+    if (path.size() > 7 && path.compare(0, 7, "/tasks/") == 0
+        && std::all_of(path.begin() + 7, path.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+        pattern = "/tasks/{id}";
+    }
+    for (size_t i = 0; i + 1 < METRIC_ROUTE_COUNT; ++i) {
+        if (method == METRIC_ROUTES[i].first && std::strcmp(pattern, METRIC_ROUTES[i].second) == 0) return i;
+    }
+    return METRIC_ROUTE_COUNT - 1;
+}
+
+// Function to render the counters behind GET /metrics in Prometheus text format
+std::string renderMetrics() {
+    std::string out;
+    std::vector<RequestMetrics::Route> routes = requestMetrics.snapshot();
+    // Only routes that have seen requests are listed
+    auto routeLabels = [](size_t route) {
+        return std::string("method=\"") + METRIC_ROUTES[route].first + "\",route=\"" + METRIC_ROUTES[route].second + "\"";
+    };
+    appendMetricHeader(out, "taskserver_http_requests_total", "counter", "Requests answered, by route and status class.");
+    for (size_t r = 0; r < routes.size(); ++r) {
+        if (routes[r].latency.count == 0) continue;
+        for (size_t i = 0; i < RequestMetrics::STATUS_CLASSES; ++i) {
+            std::string labels = routeLabels(r) + ",code=\"" + std::to_string(i + 1) + "xx\"";
+            appendMetric(out, "taskserver_http_requests_total", labels, double(routes[r].responses[i]));
+        }
+    }
+    appendMetricHeader(out, "taskserver_http_request_duration_seconds", "histogram",
+        "Time from routing a request until its response was written.");
+    for (size_t r = 0; r < routes.size(); ++r) {
+        if (routes[r].latency.count) appendHistogram(out, "taskserver_http_request_duration_seconds", routeLabels(r), routes[r].latency);
+    }
+    appendMetricHeader(out, "taskserver_http_request_latency_seconds", "summary",
+        "Request latency quantiles since startup, from the same samples as the histogram.");
+    for (size_t r = 0; r < routes.size(); ++r) {
+        if (routes[r].latency.count) appendQuantiles(out, "taskserver_http_request_latency_seconds", routeLabels(r), routes[r].latency);
+    }
+
+    GroupCommitStats log = taskLog.stats();
+    appendMetricHeader(out, "taskserver_log_flush_duration_seconds", "histogram", "Time taken to write and sync each write-ahead log batch.");
+    appendHistogram(out, "taskserver_log_flush_duration_seconds", "", log.flushTime);
+    appendMetricHeader(out, "taskserver_log_flush_latency_seconds", "summary", "Write-ahead log flush time quantiles since startup.");
+    appendQuantiles(out, "taskserver_log_flush_latency_seconds", "", log.flushTime);
+    appendMetricHeader(out, "taskserver_log_records_total", "counter", "Mutations written to the write-ahead log.");
+    appendMetric(out, "taskserver_log_records_total", "", double(log.records));
+    appendMetricHeader(out, "taskserver_log_bytes_total", "counter", "Bytes written to the write-ahead log.");
+    appendMetric(out, "taskserver_log_bytes_total", "", double(log.bytes));
+    appendMetricHeader(out, "taskserver_log_failed_batches_total", "counter", "Write-ahead log batches that could not be written.");
+    appendMetric(out, "taskserver_log_failed_batches_total", "", double(log.failedBatches));
+
+    TaskSetPtr snapshot = tasks.snapshot();
+    appendMetricHeader(out, "taskserver_tasks", "gauge", "Tasks in the store.");
+    appendMetric(out, "taskserver_tasks", "", double(snapshot->size()));
+    appendMetricHeader(out, "taskserver_store_bytes", "gauge", "Memory used by the task store.");
+    appendMetric(out, "taskserver_store_bytes", "", double(snapshot->memoryUsage()));
+    appendMetricHeader(out, "taskserver_event_streams", "gauge", "Open GET /tasks/events streams.");
+    appendMetric(out, "taskserver_event_streams", "", double(openEventStreams.load()));
+    return out;
+}
+
+// Function to apply the settings and routes shared by every server instance
+void configureServer(httplib::Server& server, const ServerConfig& config) {
+    server.set_keep_alive_timeout(config.keepAliveTimeout.count());
+    // Headers and body go out in separate writes, Nagle would delay the body until the client ACKs
+    server.set_tcp_nodelay(true);
+    // Time every request from routing until its response is written, for GET /metrics
+    server.set_pre_routing_handler([](const httplib::Request&, httplib::Response&) {
+        requestStart = std::chrono::steady_clock::now();
+        return httplib::Server::HandlerResponse::Unhandled;
+        });
+    server.set_logger([](const httplib::Request& req, const httplib::Response& res) {
+        // Requests httplib rejected before routing (malformed, too large) are not counted
+        if (requestStart == std::chrono::steady_clock::time_point()) return;
+        auto elapsed = std::chrono::steady_clock::now() - requestStart;
+        requestStart = std::chrono::steady_clock::time_point();
+        requestMetrics.record(metricRoute(req.method, req.path), res.status,
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        });
 
     // Define API routes
 
     // GET /tasks - Retrieve all tasks in JSON format
+    // GET /tasks?since=<version> - Retrieve only the tasks changed after a version
+    // GET /tasks?limit=<n>&cursor=<cursor> - Retrieve one page of tasks in ID order
     server.Get("/tasks", [](const httplib::Request& req, httplib::Response& res) {
-        json jTasks;
-        // Convert the tasks map to JSON
-        for (const auto& [id, task] : tasks) {
-            jTasks[std::to_string(id)] = task;
+        bool paged = req.has_param("limit") || req.has_param("cursor");
+        int firstId = 0;
+        size_t limit = DEFAULT_PAGE_SIZE;
+        if (paged) {
+            if (req.has_param("since")) {
+                res.status = 400;
+                res.set_content("since cannot be combined with limit or cursor", "text/plain");
+                return;
+            }
+            if (req.has_param("cursor") && !parseCursor(req.get_param_value("cursor"), firstId)) {
+                res.status = 400;
+                res.set_content("Invalid cursor", "text/plain");
+                return;
+            }
+            if (!parseLimit(req, limit)) {
+                res.status = 400;
+                res.set_content("Invalid limit", "text/plain");
+                return;
+            }
+        }
+
+        TaskSetPtr snapshot = tasks.snapshot();
+        // Nothing to send if the client already has this version
+        if (respondNotModified(req, res, snapshot->version())) {
+            return;
+        }
+        if (paged) {
+            sendDocument(req, res, taskPageToJson(*snapshot, firstId, limit));
+            return;
+        }
+        if (req.has_param("since")) {
+            sendDocument(req, res, taskDeltaToJson(*snapshot, req.get_param_value("since")));
+            return;
+        }
+        // Reuse the body serialized for this store version and format, if any
+        WireFormat format = negotiateWireFormat(req.get_header_value("Accept"));
+        auto cached = tasksResponseCaches[static_cast<int>(format)].get(snapshot->version(), [&] {
+            return serializeTasks(*snapshot, format);
+            });
+        sendCached(req, res, *cached, format);
+        });
+
+    // GET /tasks/events - Stream task changes as Server-Sent Events, resuming after Last-Event-ID
+    server.Get("/tasks/events", [&config](const httplib::Request& req, httplib::Response& res) {
+        // Each stream holds a worker thread for as long as it is open
+        if (++openEventStreams > config.maxEventStreams) {
+            --openEventStreams;
+            res.status = 503;
+            res.set_header("Retry-After", "5");
+            res.set_content("Too many event streams", "text/plain");
+            return;
         }
-        // Send the JSON response to the client
-        res.set_content(jTasks.dump(), "application/json");
+        // EventSource cannot set headers on its first request, so since= is accepted too
+        std::string lastEventId = req.has_header("Last-Event-ID")
+            ? req.get_header_value("Last-Event-ID") : req.get_param_value("since");
+        streamTaskEvents(res, lastEventId);
         });
 
     // POST /tasks - Add a new task to the list
     server.Post("/tasks", [](const httplib::Request& req, httplib::Response& res) {
+        if (rejectIfLogFailed(res)) return;
         try {
             // Parse the JSON body of the request
-            auto jTask = json::parse(req.body);
+            auto jTask = parseRequestBody(req);
+            Task task{ 0, jTask.at("description").get<std::string>() };
             // Assign a unique ID to the new task
-            jTask["id"] = nextTaskId++;
-            // Add the task to the map
-            tasks[jTask["id"]] = jTask;
-            // Save the updated tasks to the file
-            saveTasksToFile();
+            task.id = tasks.allocateId();
+            // Queue the new task for the log and add it to the store
+            uint64_t sequence = 0;
+            stageMutation({ MutationType::Create, task.id, task.description }, sequence);
+            // Respond only once the task is durable
+            if (!waitForMutation(sequence)) {
+                res.status = 500;
+                res.set_content("Failed to save task", "text/plain");
+                return;
+            }
             // Respond to the client with success message
             res.set_content("Task added successfully!", "text/plain");
         }
@@ -137,6 +1119,169 @@ void startServer() {
         }
         });
 
+    // POST /tasks/batch - Create, update and delete many tasks in one request
+    server.Post("/tasks/batch", [](const httplib::Request& req, httplib::Response& res) {
+        json jOperations;
+        try {
+            jOperations = parseRequestBody(req);
+        }
+        catch (...) {
+            res.status = 400;
+            res.set_content("Invalid JSON format", "text/plain");
+            return;
+        }
+        if (!jOperations.is_array()) {
+            res.status = 400;
+            res.set_content("Expected an array of operations", "text/plain");
+            return;
+        }
+        if (jOperations.size() > MAX_BATCH_OPERATIONS) {
+            res.status = 413;
+            res.set_content("Too many operations, the limit is " + std::to_string(MAX_BATCH_OPERATIONS), "text/plain");
+            return;
+        }
+
+        // Turn the operations into mutations, invalid ones are answered with 400 and skipped
+        json jResults = json::array();
+        std::vector<TaskMutation> mutations;
+        std::vector<size_t> resultIndex;
+        for (const auto& jOperation : jOperations) {
+            json jResult = json::object();
+            try {
+                std::string op = jOperation.at("op").get<std::string>();
+                TaskMutation mutation{ MutationType::Create, 0, "" };
+                if (op == "create") {
+                    mutation.description = jOperation.at("description").get<std::string>();
+                    mutation.id = tasks.allocateId();
+                }
+                else if (op == "update") {
+                    mutation.type = MutationType::Update;
+                    mutation.id = jOperation.at("id").get<int>();
+                    mutation.description = jOperation.at("description").get<std::string>();
+                }
+                else if (op == "delete") {
+                    mutation.type = MutationType::Delete;
+                    mutation.id = jOperation.at("id").get<int>();
+                }
+                else {
+                    throw std::invalid_argument("Unknown op: " + op);
+                }
+                if (mutation.id < 0) throw std::invalid_argument("Invalid task ID");
+                jResult["id"] = mutation.id;
+                resultIndex.push_back(jResults.size());
+                mutations.push_back(std::move(mutation));
+            }
+            catch (const std::exception& e) {
+                jResult["status"] = 400;
+                jResult["error"] = e.what();
+            }
+            jResults.push_back(jResult);
+        }
+
+        if (rejectIfLogFailed(res)) return;
+        std::vector<int> status;
+        uint64_t sequence = 0;
+        stageMutationBatch(mutations, status, sequence);
+        // One wait covers the whole batch, its records were submitted together
+        if (sequence != 0 && !waitForMutation(sequence)) {
+            res.status = 500;
+            res.set_content("Failed to save tasks", "text/plain");
+            return;
+        }
+        for (size_t i = 0; i < mutations.size(); ++i) {
+            json& jResult = jResults[resultIndex[i]];
+            jResult["status"] = status[i];
+            if (status[i] == 404) jResult["error"] = "Task not found";
+        }
+        sendDocument(req, res, json{ {"results", jResults} });
+        });
+
+    // GET /tasks/export?format=ndjson|json - Stream every task without building the whole body
+    server.Get("/tasks/export", [](const httplib::Request& req, httplib::Response& res) {
+        std::string format = req.has_param("format") ? req.get_param_value("format") : "ndjson";
+        if (format != "ndjson" && format != "json") {
+            res.status = 400;
+            res.set_content("format must be ndjson or json", "text/plain");
+            return;
+        }
+        TaskSetPtr snapshot = tasks.snapshot();
+        if (respondNotModified(req, res, snapshot->version())) {
+            return;
+        }
+        streamTaskExport(res, std::move(snapshot), format == "ndjson");
+        });
+
+    // POST /tasks/import - Bulk load tasks from newline-delimited JSON
+    server.Post("/tasks/import", [](const httplib::Request& req, httplib::Response& res, const httplib::ContentReader& contentReader) {
+        if (rejectIfLogFailed(res)) return;
+        auto start = std::chrono::steady_clock::now();
+        TaskImporter importer;
+        // The body is handed over piece by piece as it arrives, never as a whole
+        bool ok = contentReader([&](const char* data, size_t length) {
+            return importer.feed(data, length);
+            }) && importer.finish();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        json jReport = importer.report(seconds);
+        if (!ok) {
+            res.status = 500;
+            jReport["error"] = "Failed to save tasks";
+        }
+        LOG_INFO("Tasks imported", { { "imported", jReport["imported"].get<size_t>() },
+            { "rejected", jReport["rejected"].get<size_t>() }, { "seconds", seconds } });
+        sendDocument(req, res, jReport);
+        });
+
+    // GET /tasks/search?q=<query>&limit=<n> - Find tasks by the words in their description
+    // GET /tasks/search?contains=<text> - Find tasks whose description contains some text
+    // GET /tasks/search?prefix=<text> - Find tasks with a word starting with some text
+    server.Get("/tasks/search", [](const httplib::Request& req, httplib::Response& res) {
+        int kinds = req.has_param("q") + req.has_param("contains") + req.has_param("prefix");
+        if (kinds != 1) {
+            res.status = 400;
+            res.set_content("Expected exactly one of q, contains or prefix", "text/plain");
+            return;
+        }
+        size_t limit = DEFAULT_PAGE_SIZE;
+        if (!parseLimit(req, limit)) {
+            res.status = 400;
+            res.set_content("Invalid limit", "text/plain");
+            return;
+        }
+        TaskSetPtr snapshot = tasks.snapshot();
+        std::vector<int> ids = req.has_param("q")
+            ? searchIndex.search(req.get_param_value("q"))
+            : findSubstring(*snapshot, req.has_param("prefix") ? req.get_param_value("prefix") : req.get_param_value("contains"), req.has_param("prefix"));
+        // Report every match but only send the first limit tasks
+        json jResult;
+        jResult["count"] = ids.size();
+        jResult["tasks"] = json::object();
+        size_t sent = 0;
+        for (size_t i = 0; i < ids.size() && sent < limit; ++i) {
+            Task task;
+            // The index may be a change ahead of the snapshot taken above
+            if (!snapshot->get(ids[i], task)) continue;
+            jResult["tasks"][std::to_string(task.id)] = task.to_json();
+            ++sent;
+        }
+        sendDocument(req, res, jResult);
+        });
+
+    // GET /tasks/{id} - Retrieve a single task
+    server.Get(R"(/tasks/(\d+))", [](const httplib::Request& req, httplib::Response& res) {
+        int id = std::stoi(req.matches[1]);
+        TaskSetPtr snapshot = tasks.snapshot();
+        Task task;
+        if (!snapshot->get(id, task)) {
+            res.status = 404;
+            res.set_content("Task not found", "text/plain");
+            return;
+        }
+        if (respondNotModified(req, res, snapshot->version())) {
+            return;
+        }
+        sendDocument(req, res, task.to_json());
+        });
+
     // PUT /tasks/{id} - Update an existing task
     server.Put(R"(/tasks/(\d+))", [](const httplib::Request& req, httplib::Response& res) {
         // Delegate to the handleUpdateTask function
@@ -147,10 +1292,16 @@ void startServer() {
     server.Delete(R"(/tasks/(\d+))", [](const httplib::Request& req, httplib::Response& res) {
         // Extract the task ID from the URL
         int id = std::stoi(req.matches[1]);
+        if (rejectIfLogFailed(res)) return;
         // Check if the task exists and erase it
-        if (tasks.erase(id)) {
-            // Save the updated tasks to the file
-            saveTasksToFile();
+        uint64_t sequence = 0;
+        // Queue the deletion for the log and remove the task from the store
+        if (stageMutation({ MutationType::Delete, id, "" }, sequence)) {
+            if (!waitForMutation(sequence)) {
+                res.status = 500;
+                res.set_content("Failed to delete task", "text/plain");
+                return;
+            }
             // Respond with success message
             res.set_content("Task deleted successfully!", "text/plain");
         }
@@ -161,20 +1312,185 @@ void startServer() {
         }
         });
 
+    // GET /stats - Report task store and search index size and write-ahead log batching counters
+    server.Get("/stats", [](const httplib::Request& req, httplib::Response& res) {
+        json jStats;
+        TaskSetPtr snapshot = tasks.snapshot();
+        size_t count = snapshot->size();
+        size_t bytes = snapshot->memoryUsage();
+        jStats["store"]["tasks"] = count;
+        jStats["store"]["bytes"] = bytes;
+        jStats["store"]["bytes_per_task"] = count ? double(bytes) / count : 0.0;
+        jStats["search"]["words"] = searchIndex.wordCount();
+        jStats["search"]["bytes"] = searchIndex.memoryUsage();
+        jStats["search"]["trigrams"] = trigramIndex.trigramCount();
+        jStats["search"]["trigram_bytes"] = trigramIndex.memoryUsage();
+        jStats["log"] = logStatsToJson(taskLog.stats());
+        if (WorkStealingQueue* queue = executor) jStats["executor"] = executorStatsToJson(queue->stats());
+        if (!listeners.empty()) {
+            json jListeners = json::array();
+            for (const auto& listener : listeners) {
+                json jListener = listenerStatsToJson(listener->server.stats());
+                if (WorkStealingQueue* queue = listener->executor) jListener["executor"] = executorStatsToJson(queue->stats());
+                jListeners.push_back(jListener);
+            }
+            jStats["listeners"] = jListeners;
+        }
+#ifdef __linux__
+        if (EventLoopServer* loops = eventLoopServer) jStats["event_loops"] = eventLoopStatsToJson(loops->stats());
+#endif
+        sendDocument(req, res, jStats);
+        });
+
+    // GET /metrics - Report request counts and latencies, log flush times and store size for Prometheus
+    server.Get("/metrics", [](const httplib::Request&, httplib::Response& res) {
+        res.set_content(renderMetrics(), "text/plain; version=0.0.4");
+        });
+}
+
+// Function to start the HTTP server and define routes
+void startServer(const ServerConfig& config) {
+    if (config.mode != "threads" && config.mode != "epoll") {
+        throw std::invalid_argument("Unknown mode: " + config.mode);
+    }
+    if (config.listeners == 0) {
+        throw std::invalid_argument("--listeners must be at least 1");
+    }
+#ifndef __linux__
+    if (config.mode == "epoll") {
+        throw std::invalid_argument("--mode=epoll is only available on Linux");
+    }
+    // Elsewhere SO_REUSEPORT is missing or hands every connection to the last socket bound
+    if (config.listeners > 1) {
+        throw std::invalid_argument("--listeners above 1 is only available on Linux");
+    }
+#else
+    if (config.mode == "epoll" && config.listeners > 1) {
+        throw std::invalid_argument("--listeners only applies to --mode=threads, the event loops share one socket");
+    }
+    std::unique_ptr<EventLoopServer> loops;
+    if (config.mode == "epoll") {
+        loops = std::make_unique<EventLoopServer>(config.eventLoops);
+        loops->new_task_queue = executorFactory(config, executor);
+        configureServer(*loops, config);
+    }
+    else
+#endif
+    // Threads mode: every listener gets its own socket, acceptor thread and executor
+    for (size_t i = 0; i < config.listeners; ++i) {
+        auto listener = std::make_unique<ListenerInstance>(config.backlog);
+        listener->server.setExecutor(executorFactory(config, listener->executor));
+        configureServer(listener->server, config);
+        listeners.push_back(std::move(listener));
+    }
+
+    // Load tasks from file at server startup
+    tasks.setChangeLogCapacity(config.changeLogSize);
+    loadTasksFromFile();
+    // Start the log writer that batches mutations into group commits
+    if (!taskLog.open(config.groupCommit)) {
+        throw std::runtime_error("Could not open " + taskLog.path());
+    }
+    // Periodically fold the log into tasks.json so replay stays short
+    Compactor compactor;
+    compactor.start(config.compactInterval, config.compactMinLogBytes);
+
     // Log the server startup information
-    std::cout << "Server running on http://localhost:8080" << std::endl;
-    // Start listening on localhost:8080
-    server.listen("localhost", 8080);
+    LOG_INFO("Server running", { { "url", "http://" + config.host + ":" + std::to_string(config.port) } });
+    // Start listening on the configured address
+#ifdef __linux__
+    if (loops) {
+        eventLoopServer = loops.get();
+        if (!loops->run(config.host, config.port, config.backlog)) LOG_ERROR("Could not listen", { { "port", config.port } });
+        eventLoopServer = nullptr;
+        executor = nullptr;
+    }
+    else
+#endif
+    if (std::all_of(listeners.begin(), listeners.end(), [&](const auto& listener) { return listener->server.bind(config.host, config.port); })) {
+        // The first listener accepts on this thread, the others on their own
+        std::vector<std::thread> acceptors;
+        for (size_t i = 1; i < listeners.size(); ++i) {
+            acceptors.emplace_back([i] { listeners[i]->server.listen_after_bind(); });
+        }
+        listeners[0]->server.listen_after_bind();
+        for (size_t i = 1; i < listeners.size(); ++i) {
+            listeners[i]->server.wait_until_ready();
+            listeners[i]->server.stop();
+        }
+        for (auto& acceptor : acceptors) acceptor.join();
+    }
+    else {
+        LOG_ERROR("Could not listen", { { "port", config.port } });
+    }
+    // Stop compacting and flush anything still queued for the log
+    compactor.stop();
+    taskLog.close();
+    listeners.clear();
 }
 
-int main() {
+// Function to read --name=value command line options into a ServerConfig
+ServerConfig parseServerArgs(int argc, char* argv[]) {
+    ServerConfig config;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto eq = arg.find('=');
+        if (arg.rfind("--", 0) != 0 || eq == std::string::npos) {
+            throw std::invalid_argument("Expected --name=value, got: " + arg);
+        }
+        std::string name = arg.substr(2, eq - 2);
+        std::string value = arg.substr(eq + 1);
+
+        if (name == "host") config.host = value;
+        else if (name == "port") config.port = std::stoi(value);
+        else if (name == "batch-delay-us") config.groupCommit.maxBatchDelay = std::chrono::microseconds(std::stoll(value));
+        else if (name == "batch-max-bytes") config.groupCommit.maxBatchBytes = std::stoull(value);
+        else if (name == "compact-interval-s") config.compactInterval = std::chrono::seconds(std::stoll(value));
+        else if (name == "compact-min-log-bytes") config.compactMinLogBytes = std::stoull(value);
+        else if (name == "change-log-size") config.changeLogSize = std::stoull(value);
+        else if (name == "max-event-streams") config.maxEventStreams = std::stoull(value);
+        else if (name == "executor") config.executor = value;
+        else if (name == "workers") config.workers = std::stoull(value);
+        else if (name == "mode") config.mode = value;
+        else if (name == "event-loops") config.eventLoops = std::stoull(value);
+        else if (name == "listeners") config.listeners = std::stoull(value);
+        else if (name == "backlog") config.backlog = std::stoi(value);
+        else if (name == "log-level") config.log.level = parseLogLevel(value);
+        else if (name == "log-file") config.log.file = value;
+        else if (name == "log-file-bytes") config.log.maxFileBytes = std::stoull(value);
+        else if (name == "log-files") config.log.maxFiles = std::stoull(value);
+        else if (name == "keep-alive-timeout-s") config.keepAliveTimeout = std::chrono::seconds(std::stoll(value));
+        else throw std::invalid_argument("Unknown option: --" + name);
+    }
+    return config;
+}
+
+int main(int argc, char* argv[]) {
+    // server convert <in> <out> - translate between tasks.json and the binary snapshot
+    if (argc == 4 && std::string(argv[1]) == "convert") {
+        std::string in = argv[2];
+        std::string out = argv[3];
+        bool toJson = in.size() >= 5 && in.compare(in.size() - 5, 5, ".snap") == 0;
+        bool ok = toJson ? convertSnapshotToJson(in, out) : convertJsonToSnapshot(in, out);
+        std::cout << (ok ? "Converted " : "Failed to convert ") << in << " to " << out << std::endl;
+        return ok ? 0 : 1;
+    }
+
+    int exitCode = 0;
     try {
-        // Start the server
-        startServer();
+        // Start the server with the options given on the command line
+        ServerConfig config = parseServerArgs(argc, argv);
+        if (!logger.start(config.log)) {
+            throw std::runtime_error("Could not open " + config.log.file);
+        }
+        startServer(config);
     }
     catch (const std::exception& e) {
         // Log any exceptions thrown during server execution
-        std::cerr << "Error: " << e.what() << std::endl;
+        LOG_ERROR("Server stopped", { { "error", e.what() } });
+        exitCode = 1;
     }
-    return 0;
+    // Write out whatever is still queued
+    logger.stop();
+    return exitCode;
 }
@@ -1,8 +1,47 @@
 ﻿#ifndef SERVER_H
 #define SERVER_H
 #include "httplib.h"
+#include "Log.h"
+#include "TaskLog.h"
+#include <chrono>
+#include <string>
 
-void startServer();
+// Runtime settings for the task server, filled from the command line
+struct ServerConfig {
+    std::string host = "localhost";
+    int port = 8080;
+    // Latency/throughput trade-off of the write-ahead log
+    GroupCommitOptions groupCommit;
+    // How often the compactor checks the log, 0 disables compaction
+    std::chrono::seconds compactInterval{ 30 };
+    // Log size that triggers writing a new snapshot
+    uint64_t compactMinLogBytes = 1024 * 1024;
+    // Changes remembered for GET /tasks?since=, older clients get a full resync
+    size_t changeLogSize = 10000;
+    // GET /tasks/events streams allowed at once, each keeps a worker thread busy
+    size_t maxEventStreams = 4;
+    // Executor running connections: "stealing" (per-worker deques) or "pool" (httplib's ThreadPool)
+    std::string executor = "stealing";
+    // Worker threads (per listener in threads mode), 0 picks httplib's default of one per core (at least 8)
+    size_t workers = 0;
+    // Connection handling: "threads" (httplib, a worker per connection) or "epoll" (event loops, Linux only)
+    std::string mode = "threads";
+    // Listening sockets sharing the port with SO_REUSEPORT in threads mode, each with its own acceptor thread and workers
+    size_t listeners = 1;
+    // Length of each listening socket's accept queue (capped by the kernel's somaxconn)
+    int backlog = SOMAXCONN;
+    // Event loops in epoll mode, 0 starts one per core
+    size_t eventLoops = 0;
+    // How long an idle keep-alive connection stays open
+    std::chrono::seconds keepAliveTimeout{ 5 };
+    // Log level and an optional rotating log file
+    LogOptions log;
+};
+
+// Parses --name=value options, throws std::invalid_argument on bad input
+ServerConfig parseServerArgs(int argc, char* argv[]);
+
+void startServer(const ServerConfig& config = ServerConfig());
 void loadTasksFromFile();
 void saveTasksToFile();
 void handleUpdateTask(const httplib::Request& req, httplib::Response& res);
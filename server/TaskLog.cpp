@@ -0,0 +1,403 @@
+﻿#include "TaskLog.h"
+#include "Log.h"
+#include <algorithm>
+#include <filesystem>
+#include <vector>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Size of the [length][checksum] frame header in front of every record
+static const size_t FRAME_HEADER_SIZE = 8;
+// Upper bound on a single record, used to reject garbage length fields
+static const uint32_t MAX_RECORD_SIZE = 64 * 1024 * 1024;
+
+// Helpers to read and write little-endian integers independent of the host
+static void putU32(std::string& out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+static uint32_t getU32(const char* in) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value |= static_cast<uint32_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+    }
+    return value;
+}
+
+// Function to compute the CRC-32 checksum of a buffer
+uint32_t crc32(const char* data, size_t length) {
+    // Lookup table built once on first use
+    static const auto table = [] {
+        std::vector<uint32_t> t(256);
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; ++i) {
+        crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+// Function to flush a stream and make sure the data reaches the disk
+bool syncFile(std::FILE* file) {
+    if (std::fflush(file) != 0) return false;
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
+bool syncDirectory(const std::string& path) {
+#ifdef _WIN32
+    // NTFS journals directory changes itself, and a directory cannot be flushed through the CRT
+    (void)path;
+    return true;
+#else
+    std::filesystem::path parent = std::filesystem::path(path).parent_path();
+    if (parent.empty()) parent = ".";
+    int fd = ::open(parent.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return false;
+    bool ok = fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
+
+// Function to encode a mutation as [length][crc][type][id][description]
+std::string encodeLogRecord(const TaskMutation& mutation) {
+    std::string payload;
+    payload.reserve(5 + mutation.description.size());
+    payload.push_back(static_cast<char>(mutation.type));
+    putU32(payload, static_cast<uint32_t>(mutation.id));
+    if (mutation.type != MutationType::Delete) {
+        payload += mutation.description;
+    }
+
+    std::string record;
+    record.reserve(FRAME_HEADER_SIZE + payload.size());
+    putU32(record, static_cast<uint32_t>(payload.size()));
+    putU32(record, crc32(payload.data(), payload.size()));
+    record += payload;
+    return record;
+}
+
+// Function to decode a record payload, returns false if it is malformed
+static bool decodePayload(const std::string& payload, TaskMutation& mutation) {
+    if (payload.size() < 5) return false;
+    auto type = static_cast<MutationType>(payload[0]);
+    if (type != MutationType::Create && type != MutationType::Update && type != MutationType::Delete) {
+        return false;
+    }
+    mutation.type = type;
+    mutation.id = static_cast<int>(getU32(payload.data() + 1));
+    mutation.description.assign(payload, 5, std::string::npos);
+    return true;
+}
+
+TaskLog::TaskLog(std::string path) : path_(std::move(path)) {}
+
+TaskLog::~TaskLog() {
+    close();
+}
+
+// Function to build the file name of a log segment
+std::string TaskLog::segmentPath(uint64_t generation) const {
+    return path_ + "." + std::to_string(generation);
+}
+
+// Function to find the generations of all segments on disk, oldest first
+std::vector<uint64_t> TaskLog::listSegments() const {
+    std::vector<uint64_t> generations;
+    std::filesystem::path base(path_);
+    std::string prefix = base.filename().string() + ".";
+    std::filesystem::path dir = base.has_parent_path() ? base.parent_path() : std::filesystem::path(".");
+
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix) != 0) continue;
+        std::string suffix = name.substr(prefix.size());
+        if (suffix.find_first_not_of("0123456789") != std::string::npos) continue;
+        generations.push_back(std::stoull(suffix));
+    }
+    std::sort(generations.begin(), generations.end());
+    return generations;
+}
+
+// Function to replay one segment file, returns the number of records applied
+static size_t replaySegment(const std::string& path, const std::function<void(const TaskMutation&)>& apply) {
+    std::FILE* in = std::fopen(path.c_str(), "rb");
+    if (!in) {
+        // No log yet, nothing to replay
+        return 0;
+    }
+
+    size_t applied = 0;
+    uint64_t goodOffset = 0;
+    char header[FRAME_HEADER_SIZE];
+    std::string payload;
+    TaskMutation mutation;
+
+    while (std::fread(header, 1, FRAME_HEADER_SIZE, in) == FRAME_HEADER_SIZE) {
+        uint32_t length = getU32(header);
+        uint32_t checksum = getU32(header + 4);
+        if (length > MAX_RECORD_SIZE) break;
+
+        payload.resize(length);
+        if (std::fread(&payload[0], 1, length, in) != length) break;
+        // Stop at the first record that fails verification, everything after it is suspect
+        if (crc32(payload.data(), payload.size()) != checksum) break;
+        if (!decodePayload(payload, mutation)) break;
+
+        apply(mutation);
+        ++applied;
+        goodOffset += FRAME_HEADER_SIZE + length;
+    }
+
+    bool damagedTail = !std::feof(in) || std::ftell(in) != static_cast<long>(goodOffset);
+    std::fclose(in);
+
+    if (damagedTail) {
+        // Drop the torn or corrupted tail so new records are appended after valid data
+        LOG_WARN("Discarding damaged log tail", { { "path", path }, { "records", applied } });
+        std::error_code ec;
+        std::filesystem::resize_file(path, goodOffset, ec);
+        if (ec) {
+            LOG_ERROR("Could not truncate log", { { "path", path }, { "error", ec.message() } });
+        }
+    }
+    return applied;
+}
+
+// Function to replay all log segments from the oldest to the newest
+size_t TaskLog::replay(const std::function<void(const TaskMutation&)>& apply) {
+    // A log written before segments were introduced is the oldest generation
+    size_t applied = replaySegment(path_, apply);
+
+    for (uint64_t generation : listSegments()) {
+        applied += replaySegment(segmentPath(generation), apply);
+        generation_ = std::max(generation_, generation + 1);
+    }
+    return applied;
+}
+
+// Function to open a fresh segment and start the writer thread
+bool TaskLog::open(const GroupCommitOptions& options) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_) return true;
+    // Never append to a segment left by a previous run, it may already be covered by a snapshot
+    for (uint64_t generation : listSegments()) {
+        generation_ = std::max(generation_, generation + 1);
+    }
+    std::string path = segmentPath(generation_);
+    file_ = std::fopen(path.c_str(), "ab");
+    if (!file_) {
+        LOG_ERROR("Could not open log for appending", { { "path", path } });
+        return false;
+    }
+    // Without its directory entry on disk, the records synced into the segment could vanish with it
+    if (!syncDirectory(path)) {
+        LOG_ERROR("Could not sync the log directory", { { "path", path } });
+        std::fclose(file_);
+        file_ = nullptr;
+        return false;
+    }
+    options_ = options;
+    activeBytes_ = 0;
+    stopping_ = false;
+    running_ = true;
+    writer_ = std::thread(&TaskLog::writerLoop, this);
+    return true;
+}
+
+// Function to queue a record for the writer thread
+uint64_t TaskLog::submit(const TaskMutation& mutation) {
+    std::string record = encodeLogRecord(mutation);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_.empty()) {
+        pendingSince_ = std::chrono::steady_clock::now();
+        pendingCv_.notify_one();
+    }
+    pending_ += record;
+    ++pendingRecords_;
+    if (pending_.size() >= options_.maxBatchBytes) {
+        // Wake the writer early, the batch is full
+        pendingCv_.notify_one();
+    }
+    return ++submittedSeq_;
+}
+
+// Function to wait until a submitted record has been synced
+bool TaskLog::waitDurable(uint64_t sequence) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!running_) return false;
+    durableCv_.wait(lock, [&] { return durableSeq_ >= sequence || !running_; });
+    return durableSeq_ >= sequence && sequence < firstFailedSeq_;
+}
+
+bool TaskLog::failed() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return firstFailedSeq_ != UINT64_MAX;
+}
+
+// Function to durably append one mutation record
+bool TaskLog::append(const TaskMutation& mutation) {
+    return waitDurable(submit(mutation));
+}
+
+// Function to write a buffer to the active segment and sync it
+static bool writeAndSync(std::FILE* file, const char* data, size_t size) {
+    if (!file) return false;
+    if (size == 0) return true;
+    return std::fwrite(data, 1, size, file) == size && syncFile(file);
+}
+
+// Writer thread: collects queued records into batches, writes and syncs each batch once
+void TaskLog::writerLoop() {
+    std::string batch;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        pendingCv_.wait(lock, [&] { return stopping_ || rotatePending_ || !pending_.empty(); });
+        if (pending_.empty() && !rotatePending_) break;
+
+        if (!pending_.empty()) {
+            // Give concurrent handlers a chance to join this batch
+            auto deadline = pendingSince_ + options_.maxBatchDelay;
+            pendingCv_.wait_until(lock, deadline, [&] {
+                return stopping_ || pending_.size() >= options_.maxBatchBytes;
+            });
+        }
+
+        batch.clear();
+        batch.swap(pending_);
+        uint64_t batchRecords = pendingRecords_;
+        uint64_t batchEnd = submittedSeq_;
+        pendingRecords_ = 0;
+        bool rotateNow = rotatePending_;
+        size_t splitAt = rotateNow ? rotateAt_ : batch.size();
+        uint64_t nextGeneration = generation_;
+        rotatePending_ = false;
+        bool failed = firstFailedSeq_ != UINT64_MAX;
+
+        // Do the I/O without holding the lock so handlers can keep queueing
+        lock.unlock();
+        auto flushStart = std::chrono::steady_clock::now();
+        bool ok = !failed && writeAndSync(file_, batch.data(), splitAt);
+        if (rotateNow) {
+            // Records before the split belong to the sealed segment, the rest start the new one
+            if (file_) std::fclose(file_);
+            std::string path = segmentPath(nextGeneration);
+            file_ = std::fopen(path.c_str(), "ab");
+            if (!file_) {
+                LOG_ERROR("Could not open log for appending", { { "path", path } });
+            }
+            // The new segment's entry must be durable before any record in it is reported so
+            ok = ok && file_ && syncDirectory(path)
+                && writeAndSync(file_, batch.data() + splitAt, batch.size() - splitAt);
+        }
+        auto flushTime = std::chrono::steady_clock::now() - flushStart;
+        lock.lock();
+
+        if (rotateNow) {
+            activeBytes_ = 0;
+            sealedGeneration_ = nextGeneration - 1;
+        }
+        if (!ok) {
+            if (!failed) {
+                LOG_ERROR("Could not write log batch", { { "path", segmentPath(nextGeneration) } });
+            }
+            firstFailedSeq_ = std::min(firstFailedSeq_, batchEnd - batchRecords + 1);
+            ++stats_.failedBatches;
+        }
+        else if (batchRecords > 0) {
+            activeBytes_ += batch.size() - (rotateNow ? splitAt : 0);
+            ++stats_.batches;
+            stats_.records += batchRecords;
+            stats_.bytes += batch.size();
+            stats_.largestBatch = std::max(stats_.largestBatch, batchRecords);
+            size_t bucket = 0;
+            while ((uint64_t(2) << bucket) <= batchRecords && bucket + 1 < GroupCommitStats::BUCKETS) ++bucket;
+            ++stats_.batchSizeHistogram[bucket];
+            stats_.flushTime.record(std::chrono::duration_cast<std::chrono::nanoseconds>(flushTime).count());
+        }
+        durableSeq_ = batchEnd;
+        durableCv_.notify_all();
+    }
+}
+
+// Function to flush outstanding records and close the log file
+void TaskLog::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) return;
+        stopping_ = true;
+        pendingCv_.notify_one();
+    }
+    if (writer_.joinable()) writer_.join();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (file_) std::fclose(file_);
+    file_ = nullptr;
+    running_ = false;
+    durableCv_.notify_all();
+}
+
+// Function to switch new records over to a fresh segment
+LogRotation TaskLog::rotate() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!rotatePending_) {
+        rotateAt_ = pending_.size();
+        rotatePending_ = true;
+        ++generation_;
+        pendingCv_.notify_one();
+    }
+    // A rotation already waiting for the writer covers everything submitted so far as well;
+    // records after its split point just stay in the next segment and replay harmlessly
+    return { generation_ - 1, submittedSeq_ };
+}
+
+// Function to delete segments whose records are all covered by a snapshot
+void TaskLog::removeSealed(const LogRotation& rotation) {
+    {
+        // Wait until the writer has actually moved on from the sealed segments
+        std::unique_lock<std::mutex> lock(mutex_);
+        durableCv_.wait(lock, [&] { return sealedGeneration_ >= rotation.sealedGeneration || !running_; });
+        if (sealedGeneration_ < rotation.sealedGeneration) return;
+    }
+    std::error_code ec;
+    std::filesystem::remove(path_, ec);
+    for (uint64_t generation : listSegments()) {
+        if (generation > rotation.sealedGeneration) break;
+        std::filesystem::remove(segmentPath(generation), ec);
+        if (ec) {
+            LOG_ERROR("Could not remove log segment", { { "path", segmentPath(generation) }, { "error", ec.message() } });
+        }
+    }
+}
+
+// Function to report how much has been appended to the active segment
+uint64_t TaskLog::activeSegmentBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return activeBytes_ + pending_.size();
+}
+
+// Function to take a copy of the batch counters
+GroupCommitStats TaskLog::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
@@ -0,0 +1,151 @@
+﻿#ifndef TASK_LOG_H
+#define TASK_LOG_H
+
+#include "Metrics.h"
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Kind of change recorded in the write-ahead log
+enum class MutationType : uint8_t {
+    Create = 1,
+    Update = 2,
+    Delete = 3
+};
+
+// A single mutation of the task store, as stored in the log
+struct TaskMutation {
+    MutationType type;
+    int id;
+    std::string description; // New description for Create/Update, empty for Delete
+};
+
+// Knobs trading commit latency for throughput
+struct GroupCommitOptions {
+    // How long the writer waits for more records after the first one of a batch arrives
+    std::chrono::microseconds maxBatchDelay{ 1000 };
+    // A batch is flushed as soon as it holds this many bytes
+    size_t maxBatchBytes = 1024 * 1024;
+};
+
+// Counters describing the batches written so far
+struct GroupCommitStats {
+    // Number of batch-size buckets: 1, 2-3, 4-7, ..., 512+
+    static const size_t BUCKETS = 10;
+
+    uint64_t batches = 0;
+    uint64_t records = 0;
+    uint64_t bytes = 0;
+    uint64_t largestBatch = 0;
+    uint64_t failedBatches = 0;
+    std::array<uint64_t, BUCKETS> batchSizeHistogram{};
+    // Time taken to write and sync each batch, in nanoseconds
+    LatencyHistogram flushTime;
+};
+
+// Point in the log where a new segment was started
+struct LogRotation {
+    // Every segment up to and including this generation is sealed
+    uint64_t sealedGeneration;
+    // Sequence number of the last record written to the sealed segments
+    uint64_t lastSequence;
+};
+
+// Append-only write-ahead log of task mutations.
+// Every record is framed as [payload length][CRC-32 of payload][payload]
+// so a torn or corrupted tail can be detected and dropped on replay.
+// Records are handed to a dedicated writer thread which groups everything
+// that arrives close together into one write and one fsync.
+// The log is split into numbered segments (<path>.1, <path>.2, ...) so the
+// prefix covered by a snapshot can be dropped with rotate()/removeSealed().
+class TaskLog {
+public:
+    explicit TaskLog(std::string path);
+    ~TaskLog();
+
+    TaskLog(const TaskLog&) = delete;
+    TaskLog& operator=(const TaskLog&) = delete;
+
+    // Replays every segment in order and truncates any damaged tail.
+    // Returns the number of records applied.
+    size_t replay(const std::function<void(const TaskMutation&)>& apply);
+
+    // Opens the log for appending and starts the writer thread
+    bool open(const GroupCommitOptions& options = GroupCommitOptions());
+    // Queues a record for the next batch and returns its sequence number
+    uint64_t submit(const TaskMutation& mutation);
+    // Blocks until the batch holding the given record is on disk.
+    // Returns false if writing that batch failed.
+    bool waitDurable(uint64_t sequence);
+    // Submits one record and waits for it to be durable
+    bool append(const TaskMutation& mutation);
+    // True once a batch has failed to write; every later record fails too
+    bool failed() const;
+    // Flushes pending records and stops the writer thread
+    void close();
+
+    // Starts a new segment; records submitted from now on go into it.
+    // Call while holding the same lock used around submit() so the
+    // rotation point matches the state of the task map.
+    LogRotation rotate();
+    // Deletes sealed segments once their contents are in a snapshot
+    void removeSealed(const LogRotation& rotation);
+    // Bytes written to the active segment so far
+    uint64_t activeSegmentBytes() const;
+
+    GroupCommitStats stats() const;
+    const std::string& path() const { return path_; }
+
+private:
+    void writerLoop();
+    std::string segmentPath(uint64_t generation) const;
+    std::vector<uint64_t> listSegments() const;
+
+    std::string path_;
+    std::FILE* file_ = nullptr;
+    GroupCommitOptions options_;
+    // Generation of the segment records are currently appended to
+    uint64_t generation_ = 1;
+    uint64_t activeBytes_ = 0;
+    // Highest generation the writer has closed after a rotation
+    uint64_t sealedGeneration_ = 0;
+    // Offset into pending_ where the writer must switch to a new segment
+    size_t rotateAt_ = 0;
+    bool rotatePending_ = false;
+
+    mutable std::mutex mutex_;
+    // Signalled when records are queued or the log is closing
+    std::condition_variable pendingCv_;
+    // Signalled when a batch has been written
+    std::condition_variable durableCv_;
+    std::string pending_;
+    uint64_t pendingRecords_ = 0;
+    std::chrono::steady_clock::time_point pendingSince_;
+    uint64_t submittedSeq_ = 0;
+    uint64_t durableSeq_ = 0;
+    // Once a write fails every later record fails too, the file state is unknown
+    uint64_t firstFailedSeq_ = UINT64_MAX;
+    bool stopping_ = false;
+    bool running_ = false;
+    GroupCommitStats stats_;
+    std::thread writer_;
+};
+
+// Encodes a mutation into a framed log record
+std::string encodeLogRecord(const TaskMutation& mutation);
+// CRC-32 (IEEE) used to checksum log records
+uint32_t crc32(const char* data, size_t length);
+// Flushes a stdio stream and forces its contents to stable storage
+bool syncFile(std::FILE* file);
+// Forces the directory entries of the directory holding path to stable
+// storage, so a file just created or renamed there survives a crash
+bool syncDirectory(const std::string& path);
+
+#endif // TASK_LOG_H
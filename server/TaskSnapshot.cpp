@@ -0,0 +1,272 @@
+﻿#include "TaskSnapshot.h"
+#include "TaskLog.h"
+#include "Log.h"
+#include "json.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// File signature at offset 0
+static const char MAGIC[8] = { 'T', 'A', 'S', 'K', 'S', 'N', 'A', 'P' };
+// Fixed sizes of the header and of one index entry
+static const size_t HEADER_SIZE = 64;
+static const size_t INDEX_ENTRY_SIZE = 16;
+
+// Helpers to read and write little-endian integers independent of the host
+static void putU32(char* out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) out[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+}
+
+static void putU64(char* out, uint64_t value) {
+    for (int i = 0; i < 8; ++i) out[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+}
+
+static uint32_t getU32(const char* in) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) value |= static_cast<uint32_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+    return value;
+}
+
+static uint64_t getU64(const char* in) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) value |= static_cast<uint64_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+    return value;
+}
+
+TaskSnapshot::~TaskSnapshot() {
+    close();
+}
+
+// Function to map a snapshot file and check its header, index and heap
+bool TaskSnapshot::open(const std::string& path, std::string& error) {
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        error = "cannot open file";
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    length_ = static_cast<size_t>(fileSize.QuadPart);
+    HANDLE mapping = length_ ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    fileHandle_ = file;
+    mappingHandle_ = mapping;
+    if (!view) {
+        error = "cannot map file";
+        close();
+        return false;
+    }
+    data_ = static_cast<const char*>(view);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = "cannot open file";
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        error = "empty file";
+        return false;
+    }
+    length_ = static_cast<size_t>(st.st_size);
+    void* view = mmap(nullptr, length_, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid after the descriptor is closed
+    ::close(fd);
+    if (view == MAP_FAILED) {
+        error = "cannot map file";
+        length_ = 0;
+        return false;
+    }
+    data_ = static_cast<const char*>(view);
+#endif
+
+    // Validate the header before trusting any offset in it
+    if (length_ < HEADER_SIZE || std::memcmp(data_, MAGIC, sizeof(MAGIC)) != 0) {
+        error = "not a task snapshot";
+    }
+    else if (getU32(data_ + 8) != VERSION) {
+        error = "unsupported snapshot version " + std::to_string(getU32(data_ + 8));
+    }
+    else if (getU32(data_ + 60) != crc32(data_, 60)) {
+        error = "header checksum mismatch";
+    }
+    else {
+        uint64_t count = getU64(data_ + 16);
+        uint64_t indexOffset = getU64(data_ + 24);
+        uint64_t heapOffset = getU64(data_ + 32);
+        uint64_t heapSize = getU64(data_ + 40);
+        uint64_t indexSize = count * INDEX_ENTRY_SIZE;
+
+        if (count > length_ / INDEX_ENTRY_SIZE || indexOffset > length_ || indexSize > length_ - indexOffset
+            || heapOffset > length_ || heapSize > length_ - heapOffset) {
+            error = "section out of bounds";
+        }
+        else if (getU32(data_ + 48) != crc32(data_ + indexOffset, indexSize)
+            || getU32(data_ + 52) != crc32(data_ + heapOffset, heapSize)) {
+            error = "data checksum mismatch";
+        }
+        else {
+            count_ = static_cast<size_t>(count);
+            index_ = data_ + indexOffset;
+            heap_ = data_ + heapOffset;
+            // Every entry must point inside the heap so later reads need no checks
+            for (size_t i = 0; i < count_ && error.empty(); ++i) {
+                const char* entry = index_ + i * INDEX_ENTRY_SIZE;
+                uint64_t length = getU32(entry + 4);
+                uint64_t offset = getU64(entry + 8);
+                if (offset > heapSize || length > heapSize - offset) {
+                    error = "index entry out of bounds";
+                }
+            }
+        }
+    }
+
+    if (!error.empty()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+// Function to unmap the snapshot
+void TaskSnapshot::close() {
+#ifdef _WIN32
+    if (data_) UnmapViewOfFile(data_);
+    if (mappingHandle_) CloseHandle(mappingHandle_);
+    if (fileHandle_) CloseHandle(fileHandle_);
+    mappingHandle_ = nullptr;
+    fileHandle_ = nullptr;
+#else
+    if (data_) munmap(const_cast<char*>(data_), length_);
+#endif
+    data_ = nullptr;
+    length_ = 0;
+    count_ = 0;
+    index_ = nullptr;
+    heap_ = nullptr;
+}
+
+int TaskSnapshot::idAt(size_t index) const {
+    return static_cast<int>(getU32(index_ + index * INDEX_ENTRY_SIZE));
+}
+
+std::string_view TaskSnapshot::descriptionAt(size_t index) const {
+    const char* entry = index_ + index * INDEX_ENTRY_SIZE;
+    return std::string_view(heap_ + getU64(entry + 8), getU32(entry + 4));
+}
+
+// Function to write a snapshot file atomically
+bool writeTaskSnapshot(const std::string& path, std::vector<std::pair<int, std::string>> tasks) {
+    std::sort(tasks.begin(), tasks.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    // Build the index and the heap in memory so their checksums go into the header
+    std::string index(tasks.size() * INDEX_ENTRY_SIZE, '\0');
+    std::string heap;
+    size_t heapSize = 0;
+    for (const auto& task : tasks) heapSize += task.second.size();
+    heap.reserve(heapSize);
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        char* entry = &index[i * INDEX_ENTRY_SIZE];
+        putU32(entry, static_cast<uint32_t>(tasks[i].first));
+        putU32(entry + 4, static_cast<uint32_t>(tasks[i].second.size()));
+        putU64(entry + 8, heap.size());
+        heap += tasks[i].second;
+    }
+
+    char header[HEADER_SIZE] = {};
+    std::memcpy(header, MAGIC, sizeof(MAGIC));
+    putU32(header + 8, TaskSnapshot::VERSION);
+    putU32(header + 12, static_cast<uint32_t>(HEADER_SIZE));
+    putU64(header + 16, tasks.size());
+    putU64(header + 24, HEADER_SIZE);
+    putU64(header + 32, HEADER_SIZE + index.size());
+    putU64(header + 40, heap.size());
+    putU32(header + 48, crc32(index.data(), index.size()));
+    putU32(header + 52, crc32(heap.data(), heap.size()));
+    putU32(header + 60, crc32(header, 60));
+
+    std::string tempPath = path + ".tmp";
+    std::FILE* file = std::fopen(tempPath.c_str(), "wb");
+    if (!file) {
+        LOG_ERROR("Could not open snapshot for writing", { { "path", tempPath } });
+        return false;
+    }
+    bool ok = std::fwrite(header, 1, HEADER_SIZE, file) == HEADER_SIZE
+        && std::fwrite(index.data(), 1, index.size(), file) == index.size()
+        && std::fwrite(heap.data(), 1, heap.size(), file) == heap.size()
+        && syncFile(file);
+    std::fclose(file);
+
+    std::error_code ec;
+    if (ok) std::filesystem::rename(tempPath, path, ec);
+    if (!ok || ec) {
+        LOG_ERROR("Could not write snapshot", { { "path", path } });
+        std::filesystem::remove(tempPath, ec);
+        return false;
+    }
+    // Until the rename itself is on disk the caller must keep the log segments the snapshot covers
+    if (!syncDirectory(path)) {
+        LOG_ERROR("Could not sync the snapshot directory", { { "path", path } });
+        return false;
+    }
+    return true;
+}
+
+// Function to convert a tasks.json file into a binary snapshot
+bool convertJsonToSnapshot(const std::string& jsonPath, const std::string& snapshotPath) {
+    std::ifstream file(jsonPath);
+    if (!file.is_open()) {
+        LOG_ERROR("Could not open tasks file", { { "path", jsonPath } });
+        return false;
+    }
+    std::vector<std::pair<int, std::string>> tasks;
+    try {
+        nlohmann::json jTasks;
+        file >> jTasks;
+        for (const auto& [key, value] : jTasks.items()) {
+            tasks.emplace_back(std::stoi(key), value.value("description", std::string()));
+        }
+    }
+    catch (const std::exception& e) {
+        LOG_ERROR("Failed to parse tasks file", { { "path", jsonPath }, { "error", e.what() } });
+        return false;
+    }
+    return writeTaskSnapshot(snapshotPath, std::move(tasks));
+}
+
+// Function to convert a binary snapshot back into the tasks.json layout
+bool convertSnapshotToJson(const std::string& snapshotPath, const std::string& jsonPath) {
+    TaskSnapshot snapshot;
+    std::string error;
+    if (!snapshot.open(snapshotPath, error)) {
+        LOG_ERROR("Could not read snapshot", { { "path", snapshotPath }, { "error", error } });
+        return false;
+    }
+    nlohmann::json jTasks = nlohmann::json::object();
+    for (size_t i = 0; i < snapshot.size(); ++i) {
+        int id = snapshot.idAt(i);
+        jTasks[std::to_string(id)] = { {"id", id}, {"description", std::string(snapshot.descriptionAt(i))} };
+    }
+    std::ofstream out(jsonPath);
+    if (!out.is_open()) {
+        LOG_ERROR("Could not open tasks file for writing", { { "path", jsonPath } });
+        return false;
+    }
+    out << jTasks.dump(4);
+    return out.good();
+}
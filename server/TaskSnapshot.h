@@ -0,0 +1,60 @@
+﻿#ifndef TASK_SNAPSHOT_H
+#define TASK_SNAPSHOT_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Binary point-in-time copy of the task list, written by the compactor.
+//
+// Layout (all integers little-endian):
+//   header  magic "TASKSNAP", version, task count, offsets/sizes of the
+//           sections below, CRC-32 of the index, the heap and the header
+//   index   one fixed-size entry per task sorted by id: id, length, heap offset
+//   heap    task descriptions back to back, not NUL-terminated
+//
+// The file is memory-mapped. open() validates all of it, checking the
+// CRCs of the header, the index and the whole description heap, so a
+// damaged snapshot is refused before anything is read from it. Startup
+// then copies every description out of the mapping into the task store;
+// the mapping is only kept for as long as that load takes.
+class TaskSnapshot {
+public:
+    static const uint32_t VERSION = 1;
+
+    TaskSnapshot() = default;
+    ~TaskSnapshot();
+
+    TaskSnapshot(const TaskSnapshot&) = delete;
+    TaskSnapshot& operator=(const TaskSnapshot&) = delete;
+
+    // Maps and validates a snapshot file, returns false with a reason on failure
+    bool open(const std::string& path, std::string& error);
+    void close();
+
+    size_t size() const { return count_; }
+    int idAt(size_t index) const;
+    std::string_view descriptionAt(size_t index) const;
+
+private:
+    const char* data_ = nullptr;
+    size_t length_ = 0;
+    size_t count_ = 0;
+    const char* index_ = nullptr;
+    const char* heap_ = nullptr;
+#ifdef _WIN32
+    void* fileHandle_ = nullptr;
+    void* mappingHandle_ = nullptr;
+#endif
+};
+
+// Writes tasks (id, description) as a snapshot via a synced temp file and rename
+bool writeTaskSnapshot(const std::string& path, std::vector<std::pair<int, std::string>> tasks);
+
+// Converters between a snapshot and the {"<id>": {"id", "description"}} layout of tasks.json
+bool convertJsonToSnapshot(const std::string& jsonPath, const std::string& snapshotPath);
+bool convertSnapshotToJson(const std::string& snapshotPath, const std::string& jsonPath);
+
+#endif // TASK_SNAPSHOT_H
@@ -0,0 +1,345 @@
+﻿#include "TaskStore.h"
+#include <algorithm>
+#include <climits>
+#include <iterator>
+#include <stdexcept>
+
+// Garbage below this size is never worth rewriting the arena for
+static const size_t COMPACT_MIN_BYTES = 64 * 1024;
+
+// Function to map a task ID onto this store's slot vector
+long long TaskStore::slotIndex(int id) const {
+    if (id < offset_) return -1;
+    return id - offset_;
+}
+
+bool TaskStore::contains(int id) const {
+    long long index = slotIndex(id);
+    return index >= 0 && static_cast<size_t>(index) < slots_.size() && slots_[index].length != EMPTY;
+}
+
+// Function to copy a task out of the store
+bool TaskStore::get(int id, Task& task) const {
+    if (!contains(id)) return false;
+    task.id = id;
+    task.description.assign(description(id));
+    return true;
+}
+
+std::string_view TaskStore::description(int id) const {
+    if (!contains(id)) return {};
+    const Slot& slot = slots_[slotIndex(id)];
+    return std::string_view(arena_.data() + slot.offset, slot.length);
+}
+
+// Function to insert or update a task
+void TaskStore::put(int id, std::string_view description) {
+    long long index = slotIndex(id);
+    if (index < 0) throw std::invalid_argument("Task ID does not belong to this store");
+    if (description.size() >= EMPTY) throw std::length_error("Task description too long");
+    if (static_cast<size_t>(index) >= slots_.size()) {
+        slots_.resize(static_cast<size_t>(index) + 1);
+    }
+
+    Slot& slot = slots_[index];
+    ++changes_;
+    if (slot.length != EMPTY && description.size() <= slot.length) {
+        // The new text fits where the old one was, reuse that space
+        arena_.replace(slot.offset, description.size(), description.data(), description.size());
+        garbage_ += slot.length - description.size();
+        slot.length = static_cast<uint32_t>(description.size());
+        return;
+    }
+
+    if (arena_.size() + description.size() > EMPTY) {
+        compactArena();
+        if (arena_.size() + description.size() > EMPTY) throw std::length_error("Task store arena is full");
+    }
+    if (slot.length != EMPTY) {
+        garbage_ += slot.length;
+    }
+    else {
+        ++count_;
+    }
+    slot.offset = static_cast<uint32_t>(arena_.size());
+    slot.length = static_cast<uint32_t>(description.size());
+    arena_.append(description.data(), description.size());
+
+    if (garbage_ > COMPACT_MIN_BYTES && garbage_ > arena_.size() / 2) {
+        compactArena();
+    }
+}
+
+// Function to remove a task
+bool TaskStore::erase(int id) {
+    if (!contains(id)) return false;
+    Slot& slot = slots_[slotIndex(id)];
+    garbage_ += slot.length;
+    slot = Slot();
+    --count_;
+    ++changes_;
+    if (garbage_ > COMPACT_MIN_BYTES && garbage_ > arena_.size() / 2) {
+        compactArena();
+    }
+    return true;
+}
+
+void TaskStore::reserve(size_t tasks, size_t descriptionBytes) {
+    slots_.reserve(tasks + 1);
+    arena_.reserve(descriptionBytes);
+}
+
+TaskStore TaskStore::compacted() const {
+    TaskStore copy(*this);
+    // Slots past the highest live ID only remain from deleted tasks
+    while (!copy.slots_.empty() && copy.slots_.back().length == EMPTY) copy.slots_.pop_back();
+    if (copy.garbage_ > 0) copy.compactArena();
+    return copy;
+}
+
+// Function to move every live description to the front of a fresh arena
+void TaskStore::compactArena() {
+    std::string compacted;
+    compacted.reserve(arena_.size() - garbage_);
+    for (Slot& slot : slots_) {
+        if (slot.length == EMPTY) continue;
+        uint32_t offset = static_cast<uint32_t>(compacted.size());
+        compacted.append(arena_, slot.offset, slot.length);
+        slot.offset = offset;
+    }
+    arena_.swap(compacted);
+    garbage_ = 0;
+}
+
+size_t TaskStore::memoryUsage() const {
+    return sizeof(*this) + slots_.capacity() * sizeof(Slot) + arena_.capacity();
+}
+
+
+const TaskStore* TaskSet::chunkFor(int id) const {
+    if (id < 0) return nullptr;
+    size_t chunk = static_cast<size_t>(id) / CHUNK_TASKS;
+    size_t group = chunk / GROUP_CHUNKS;
+    if (group >= groups_.size() || !groups_[group]) return nullptr;
+    return groups_[group]->chunks[chunk % GROUP_CHUNKS].get();
+}
+
+bool TaskSet::contains(int id) const {
+    const TaskStore* chunk = chunkFor(id);
+    return chunk && chunk->contains(id);
+}
+
+bool TaskSet::get(int id, Task& task) const {
+    const TaskStore* chunk = chunkFor(id);
+    return chunk && chunk->get(id, task);
+}
+
+std::string_view TaskSet::description(int id) const {
+    const TaskStore* chunk = chunkFor(id);
+    return chunk ? chunk->description(id) : std::string_view();
+}
+
+size_t TaskSet::memoryUsage() const {
+    size_t total = sizeof(*this) + groups_.capacity() * sizeof(groups_[0]);
+    for (const auto& group : groups_) {
+        if (!group) continue;
+        total += sizeof(Group);
+        for (const auto& chunk : group->chunks) {
+            if (chunk) total += chunk->memoryUsage();
+        }
+    }
+    return total;
+}
+
+// Function to add or replace a task in the set being built
+void TaskSetBuilder::put(int id, std::string_view description) {
+    if (id < 0) throw std::invalid_argument("Task ID must not be negative");
+    size_t chunk = static_cast<size_t>(id) / TaskSet::CHUNK_TASKS;
+    if (chunk >= chunks_.size()) chunks_.resize(chunk + 1);
+    if (!chunks_[chunk]) {
+        chunks_[chunk] = std::make_unique<TaskStore>(static_cast<int>(chunk) * TaskSet::CHUNK_TASKS);
+    }
+    chunks_[chunk]->put(id, description);
+}
+
+bool TaskSetBuilder::erase(int id) {
+    if (id < 0) return false;
+    size_t chunk = static_cast<size_t>(id) / TaskSet::CHUNK_TASKS;
+    return chunk < chunks_.size() && chunks_[chunk] && chunks_[chunk]->erase(id);
+}
+
+// Function to freeze the collected chunks into a TaskSet
+TaskSetPtr TaskSetBuilder::build(uint64_t version) {
+    auto set = std::make_shared<TaskSet>();
+    set->version_ = version;
+    std::vector<std::shared_ptr<TaskSet::Group>> groups;
+    for (size_t chunk = 0; chunk < chunks_.size(); ++chunk) {
+        if (!chunks_[chunk] || chunks_[chunk]->size() == 0) continue;
+        size_t group = chunk / TaskSet::GROUP_CHUNKS;
+        if (group >= groups.size()) groups.resize(group + 1);
+        if (!groups[group]) groups[group] = std::make_shared<TaskSet::Group>();
+        set->count_ += chunks_[chunk]->size();
+        groups[group]->chunks[chunk % TaskSet::GROUP_CHUNKS] = std::make_shared<TaskStore>(chunks_[chunk]->compacted());
+    }
+    set->groups_.assign(groups.begin(), groups.end());
+    chunks_.clear();
+    return set;
+}
+
+const TaskStore* TaskBatch::chunkFor(int id) const {
+    if (id < 0) return nullptr;
+    auto copied = chunks_.find(static_cast<size_t>(id) / TaskSet::CHUNK_TASKS);
+    return copied != chunks_.end() ? copied->second.get() : base_->chunkFor(id);
+}
+
+bool TaskBatch::contains(int id) const {
+    const TaskStore* chunk = chunkFor(id);
+    return chunk && chunk->contains(id);
+}
+
+std::string_view TaskBatch::description(int id) const {
+    const TaskStore* chunk = chunkFor(id);
+    return chunk ? chunk->description(id) : std::string_view();
+}
+
+TaskStore& TaskBatch::writableChunk(int id) {
+    if (id < 0) throw std::invalid_argument("Task ID must not be negative");
+    size_t index = static_cast<size_t>(id) / TaskSet::CHUNK_TASKS;
+    auto& chunk = chunks_[index];
+    if (!chunk) {
+        const TaskStore* existing = base_->chunkFor(id);
+        chunk = std::make_shared<TaskStore>(existing ? existing->compacted()
+            : TaskStore(static_cast<int>(index) * TaskSet::CHUNK_TASKS));
+    }
+    return *chunk;
+}
+
+void TaskBatch::put(int id, std::string_view description) {
+    writableChunk(id).put(id, description);
+    changed_.push_back(id);
+}
+
+bool TaskBatch::erase(int id) {
+    if (!contains(id)) return false;
+    writableChunk(id).erase(id);
+    changed_.push_back(id);
+    return true;
+}
+
+ConcurrentTaskStore::ConcurrentTaskStore(size_t stripes)
+    : stripes_(stripes ? stripes : 1), current_(std::make_shared<TaskSet>()) {}
+
+// Function to move the ID counter past an ID that is already taken
+void ConcurrentTaskStore::reserveId(int id) {
+    if (id == INT_MAX) throw std::out_of_range("Task ID too large");
+    int current = nextId_.load();
+    while (current <= id && !nextId_.compare_exchange_weak(current, id + 1)) {
+    }
+}
+
+void ConcurrentTaskStore::reset(TaskSetPtr tasks) {
+    std::lock_guard<std::mutex> lock(publishMutex_);
+    {
+        // Changes made to the previous contents say nothing about the new ones
+        std::lock_guard<std::mutex> changesLock(changesMutex_);
+        changes_.clear();
+        changesFloor_ = tasks->version();
+    }
+    publish(std::move(tasks));
+}
+
+void ConcurrentTaskStore::publish(TaskSetPtr tasks) {
+    {
+        // Storing under the lock means a waiter cannot miss the notification
+        std::lock_guard<std::mutex> lock(versionMutex_);
+        std::atomic_store(&current_, std::move(tasks));
+    }
+    versionChanged_.notify_all();
+}
+
+TaskSetPtr ConcurrentTaskStore::waitForVersion(uint64_t version, std::chrono::milliseconds timeout) const {
+    std::unique_lock<std::mutex> lock(versionMutex_);
+    versionChanged_.wait_for(lock, timeout, [&] { return snapshot()->version() > version; });
+    return snapshot();
+}
+
+int ConcurrentTaskStore::chunkBase(int id) {
+    if (id < 0) throw std::invalid_argument("Task ID must not be negative");
+    return id - id % TaskSet::CHUNK_TASKS;
+}
+
+std::mutex& ConcurrentTaskStore::stripeFor(int id) {
+    return stripes_[(static_cast<unsigned>(id) / TaskSet::CHUNK_TASKS) % stripes_.size()];
+}
+
+// Function to publish a new version with some chunks replaced
+void ConcurrentTaskStore::publishChunks(const std::map<size_t, std::shared_ptr<TaskStore>>& chunks, const std::vector<int>& ids) {
+    TaskSetPtr current = snapshot();
+    auto next = std::make_shared<TaskSet>(*current);
+
+    // Chunks come sorted by index, so each touched group is copied once
+    std::shared_ptr<TaskSet::Group> group;
+    size_t groupIndex = SIZE_MAX;
+    for (const auto& [chunkIndex, chunk] : chunks) {
+        if (chunkIndex / TaskSet::GROUP_CHUNKS != groupIndex) {
+            if (group) next->groups_[groupIndex] = std::move(group);
+            groupIndex = chunkIndex / TaskSet::GROUP_CHUNKS;
+            if (groupIndex >= next->groups_.size()) next->groups_.resize(groupIndex + 1);
+            group = next->groups_[groupIndex]
+                ? std::make_shared<TaskSet::Group>(*next->groups_[groupIndex])
+                : std::make_shared<TaskSet::Group>();
+        }
+        auto& slot = group->chunks[chunkIndex % TaskSet::GROUP_CHUNKS];
+        next->count_ -= slot ? slot->size() : 0;
+        next->count_ += chunk->size();
+        if (chunk->size() > 0) slot = chunk;
+        else slot.reset();
+    }
+    if (group) next->groups_[groupIndex] = std::move(group);
+
+    ++next->version_;
+    for (int id : ids) recordChange(next->version_, id, !current->contains(id));
+    publish(std::move(next));
+}
+
+// Function to remember which task a version changed, dropping the oldest entries
+void ConcurrentTaskStore::recordChange(uint64_t version, int id, bool created) {
+    std::lock_guard<std::mutex> lock(changesMutex_);
+    changes_.push_back({ version, id, created });
+    while (changes_.size() > changeCapacity_) {
+        changesFloor_ = changes_.front().version;
+        changes_.pop_front();
+    }
+}
+
+void ConcurrentTaskStore::setChangeLogCapacity(size_t capacity) {
+    std::lock_guard<std::mutex> lock(changesMutex_);
+    changeCapacity_ = capacity;
+    while (changes_.size() > changeCapacity_) {
+        changesFloor_ = changes_.front().version;
+        changes_.pop_front();
+    }
+}
+
+// Function to list the tasks touched between two versions
+bool ConcurrentTaskStore::changedSince(uint64_t since, uint64_t until, std::vector<int>& ids) const {
+    std::lock_guard<std::mutex> lock(changesMutex_);
+    if (since < changesFloor_ || since > until) return false;
+    for (auto it = changes_.rbegin(); it != changes_.rend() && it->version > since; ++it) {
+        if (it->version <= until) ids.push_back(it->id);
+    }
+    // A task changed several times is only reported once
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return true;
+}
+
+bool ConcurrentTaskStore::changesSince(uint64_t since, uint64_t until, std::vector<Change>& changes) const {
+    std::lock_guard<std::mutex> lock(changesMutex_);
+    if (since < changesFloor_ || since > until) return false;
+    // Entries are in version order, so find the first one after since from the back
+    auto first = changes_.end();
+    while (first != changes_.begin() && std::prev(first)->version > since) --first;
+    for (auto it = first; it != changes_.end() && it->version <= until; ++it) changes.push_back(*it);
+    return true;
+}
@@ -0,0 +1,340 @@
+﻿#ifndef TASK_STORE_H
+#define TASK_STORE_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Task.h"
+
+// Dense in-memory table of tasks.
+// Task IDs are handed out sequentially, so each task lives in a slot of a
+// vector indexed directly by its ID. A slot only records where the
+// description sits in a shared string arena, which keeps a task at
+// 8 bytes of bookkeeping plus its text and makes lookups a single index.
+// A store can start at a non-zero ID, which is how ConcurrentTaskStore
+// keeps each fixed-size chunk of the ID space in its own small store.
+//
+// There is no free list of slots: a slot's position is its task's ID, and
+// IDs are never handed out twice, so a freed slot could only be reused
+// through an extra ID-to-slot table costing memory and a second lookup on
+// every access. A deleted task instead leaves an 8-byte empty slot behind.
+// That is bounded by the chunk size: compacted() drops trailing empty
+// slots, and a chunk whose tasks are all deleted is dropped from the
+// TaskSet altogether. Freed arena bytes are reclaimed by compaction too.
+class TaskStore {
+public:
+    explicit TaskStore(int offset = 0) : offset_(offset) {}
+
+    bool contains(int id) const;
+    // Copies a task out of the store, returns false if it does not exist
+    bool get(int id, Task& task) const;
+    // Description of a task; only valid until the store is next modified
+    std::string_view description(int id) const;
+
+    // Inserts a new task or replaces the description of an existing one
+    void put(int id, std::string_view description);
+    void put(const Task& task) { put(task.id, task.description); }
+    // Removes a task, returns false if it did not exist
+    bool erase(int id);
+
+    size_t size() const { return count_; }
+    void reserve(size_t tasks, size_t descriptionBytes);
+    // Copy of the store without arena garbage or trailing empty slots
+    TaskStore compacted() const;
+    // Incremented by every put() and successful erase()
+    uint64_t changeCount() const { return changes_; }
+
+    // Calls fn(id, description) for every task in ascending ID order
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        for (size_t index = 0; index < slots_.size(); ++index) {
+            const Slot& slot = slots_[index];
+            if (slot.length != EMPTY) {
+                fn(static_cast<int>(index) + offset_, std::string_view(arena_.data() + slot.offset, slot.length));
+            }
+        }
+    }
+
+    // Calls fn(id, description) in ascending ID order for tasks with an ID of
+    // at least firstId, until fn returns false; returns false if fn stopped early
+    template <typename Fn>
+    bool forEachFrom(int firstId, Fn&& fn) const {
+        long long first = slotIndex(firstId);
+        for (size_t index = first < 0 ? 0 : static_cast<size_t>(first); index < slots_.size(); ++index) {
+            const Slot& slot = slots_[index];
+            if (slot.length != EMPTY
+                && !fn(static_cast<int>(index) + offset_, std::string_view(arena_.data() + slot.offset, slot.length))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Heap bytes held by the store
+    size_t memoryUsage() const;
+
+private:
+    static const uint32_t EMPTY = UINT32_MAX;
+
+    struct Slot {
+        uint32_t offset = 0;
+        uint32_t length = EMPTY;
+    };
+
+    // Position of an ID in slots_, or -1 if the ID does not belong to this store
+    long long slotIndex(int id) const;
+    // Rewrites the arena without the space left by updated or deleted tasks
+    void compactArena();
+
+    int offset_;
+    std::vector<Slot> slots_;
+    std::string arena_;
+    // Arena bytes no longer referenced by any slot
+    size_t garbage_ = 0;
+    size_t count_ = 0;
+    uint64_t changes_ = 0;
+};
+
+// Immutable view of every task at one store version.
+// Tasks are kept in chunks of CHUNK_TASKS consecutive IDs, grouped
+// GROUP_CHUNKS at a time. Versions share every chunk and group they did not
+// change, so publishing a new version copies one chunk, one group and the
+// short list of groups rather than the whole task set.
+class TaskSet {
+public:
+    static const int CHUNK_TASKS = 256;
+    static const int GROUP_CHUNKS = 64;
+
+    uint64_t version() const { return version_; }
+    size_t size() const { return count_; }
+
+    bool contains(int id) const;
+    bool get(int id, Task& task) const;
+    // Description of a task, valid for as long as this TaskSet is alive
+    std::string_view description(int id) const;
+
+    // Calls fn(id, description) for every task in ascending ID order
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        for (const auto& group : groups_) {
+            if (!group) continue;
+            for (const auto& chunk : group->chunks) {
+                if (chunk) chunk->forEach(fn);
+            }
+        }
+    }
+
+    // Like forEach, but starts at firstId and stops as soon as fn returns
+    // false. Chunks before firstId are skipped without being looked at, so a
+    // page costs the tasks it visits rather than the size of the set.
+    template <typename Fn>
+    void forEachFrom(int firstId, Fn&& fn) const {
+        if (firstId < 0) firstId = 0;
+        size_t firstChunk = static_cast<size_t>(firstId) / CHUNK_TASKS;
+        for (size_t group = firstChunk / GROUP_CHUNKS; group < groups_.size(); ++group) {
+            if (!groups_[group]) continue;
+            size_t chunk = group == firstChunk / GROUP_CHUNKS ? firstChunk % GROUP_CHUNKS : 0;
+            for (; chunk < GROUP_CHUNKS; ++chunk) {
+                const auto& store = groups_[group]->chunks[chunk];
+                if (store && !store->forEachFrom(firstId, fn)) return;
+            }
+        }
+    }
+
+    // Heap bytes held by this version, counting shared chunks as well
+    size_t memoryUsage() const;
+
+private:
+    friend class TaskSetBuilder;
+    friend class TaskBatch;
+    friend class ConcurrentTaskStore;
+
+    struct Group {
+        std::array<std::shared_ptr<const TaskStore>, GROUP_CHUNKS> chunks;
+    };
+
+    // Chunk holding the ID, or nullptr if it has no tasks
+    const TaskStore* chunkFor(int id) const;
+
+    std::vector<std::shared_ptr<const Group>> groups_;
+    uint64_t version_ = 0;
+    size_t count_ = 0;
+};
+
+using TaskSetPtr = std::shared_ptr<const TaskSet>;
+
+// Builds a TaskSet in one go, e.g. while loading tasks at startup,
+// without publishing a version per task
+class TaskSetBuilder {
+public:
+    void put(int id, std::string_view description);
+    bool erase(int id);
+    TaskSetPtr build(uint64_t version = 0);
+
+private:
+    std::vector<std::unique_ptr<TaskStore>> chunks_;
+};
+
+// Changes made by one ConcurrentTaskStore::writeBatch() call.
+// Reads see the batch's own earlier changes; every chunk it touches is
+// copied once, and all of them are published together as one version.
+class TaskBatch {
+public:
+    bool contains(int id) const;
+    std::string_view description(int id) const;
+    void put(int id, std::string_view description);
+    bool erase(int id);
+
+    // IDs put or erased so far, in the order they were changed
+    const std::vector<int>& changedIds() const { return changed_; }
+
+private:
+    friend class ConcurrentTaskStore;
+
+    explicit TaskBatch(TaskSetPtr base) : base_(std::move(base)) {}
+    // Chunk owning the ID as seen by this batch, or nullptr if it has no tasks
+    const TaskStore* chunkFor(int id) const;
+    // Private copy of the chunk owning the ID, made on first use
+    TaskStore& writableChunk(int id);
+
+    TaskSetPtr base_;
+    // Copied chunks by chunk index
+    std::map<size_t, std::shared_ptr<TaskStore>> chunks_;
+    std::vector<int> changed_;
+};
+
+// Task store shared by all request handlers.
+// Readers grab the current TaskSet with snapshot() and work on it without
+// taking any store lock; the set is freed once the last reader drops it.
+// Writers copy the chunk owning a task, change the copy and publish a new
+// TaskSet that shares everything else with the previous one. Writers to
+// chunks on different stripes only meet briefly on the publish lock.
+// IDs come from an atomic counter. A bounded change log remembers which
+// task each recent version touched so clients can sync deltas.
+class ConcurrentTaskStore {
+public:
+    // One change log entry: a task touched by a version
+    struct Change {
+        uint64_t version;
+        int id;
+        // The task did not exist before this version
+        bool created;
+    };
+
+    explicit ConcurrentTaskStore(size_t stripes = 16);
+
+    // Hands out the next unused task ID
+    int allocateId() { return nextId_.fetch_add(1); }
+    // Makes sure IDs already in use (e.g. loaded from disk) are never handed out again.
+    // Throws std::out_of_range for INT_MAX, which would leave no ID after it.
+    void reserveId(int id);
+    int nextId() const { return nextId_.load(); }
+
+    // Current version of the task set
+    TaskSetPtr snapshot() const { return std::atomic_load(&current_); }
+    // Replaces the whole task set, used once tasks have been loaded from disk
+    void reset(TaskSetPtr tasks);
+
+    // Runs fn(TaskStore& chunk) on a private copy of the chunk owning the ID
+    // and returns its result. If fn changed the chunk, publish() is called
+    // with the publish lock held, right before the new version becomes
+    // visible, so anything it records (such as a log record) is ordered
+    // exactly like the versions.
+    template <typename Fn, typename Publish>
+    auto write(int id, Fn&& fn, Publish&& publish) {
+        std::lock_guard<std::mutex> lock(stripeFor(id));
+        // Only this stripe's holder can replace the chunk, so the copy stays current
+        const TaskStore* existing = snapshot()->chunkFor(id);
+        auto chunk = std::make_shared<TaskStore>(existing ? existing->compacted() : TaskStore(chunkBase(id)));
+        uint64_t changes = chunk->changeCount();
+        auto result = fn(*chunk);
+        if (chunk->changeCount() != changes) {
+            std::lock_guard<std::mutex> publishLock(publishMutex_);
+            publish();
+            publishChunks({ { static_cast<size_t>(id) / TaskSet::CHUNK_TASKS, std::move(chunk) } }, { id });
+        }
+        return result;
+    }
+
+    // Runs fn(TaskBatch& batch) with every stripe locked, for changes that
+    // span many chunks, and returns its result. If fn changed anything,
+    // publish() is called with the publish lock held and all changes become
+    // visible at once as a single new version.
+    template <typename Fn, typename Publish>
+    auto writeBatch(Fn&& fn, Publish&& publish) {
+        // Stripes are always taken in the same order, so batches cannot deadlock each other
+        std::vector<std::unique_lock<std::mutex>> locks;
+        locks.reserve(stripes_.size());
+        for (auto& stripe : stripes_) locks.emplace_back(stripe);
+        TaskBatch batch(snapshot());
+        auto result = fn(batch);
+        if (!batch.changed_.empty()) {
+            std::lock_guard<std::mutex> publishLock(publishMutex_);
+            publish();
+            publishChunks(batch.chunks_, batch.changed_);
+        }
+        return result;
+    }
+
+    // Runs fn(snapshot) with the publish lock held, so no new version can
+    // appear while fn runs; used to line a snapshot up with a log rotation
+    template <typename Fn>
+    void withPublishLocked(Fn&& fn) {
+        std::lock_guard<std::mutex> lock(publishMutex_);
+        fn(snapshot());
+    }
+
+    // Collects the IDs of tasks changed after version since, up to and
+    // including version until. Returns false if some of those changes have
+    // already dropped out of the change log, or since is not a version of
+    // this store; the caller then has to fall back to a full resync.
+    bool changedSince(uint64_t since, uint64_t until, std::vector<int>& ids) const;
+    // Like changedSince(), but returns the change log entries themselves,
+    // oldest first, with a task listed once for every version that touched it
+    bool changesSince(uint64_t since, uint64_t until, std::vector<Change>& changes) const;
+    // Blocks until a version newer than the given one is published or the
+    // timeout passes, then returns the current version of the task set
+    TaskSetPtr waitForVersion(uint64_t version, std::chrono::milliseconds timeout) const;
+    // Number of (version, task) changes kept for changedSince()
+    void setChangeLogCapacity(size_t capacity);
+
+    bool contains(int id) const { return snapshot()->contains(id); }
+    bool get(int id, Task& task) const { return snapshot()->get(id, task); }
+    size_t size() const { return snapshot()->size(); }
+    size_t memoryUsage() const { return snapshot()->memoryUsage(); }
+
+private:
+    static int chunkBase(int id);
+    std::mutex& stripeFor(int id);
+    // Swaps changed chunks (by chunk index) into a new version that records
+    // the given task IDs as changed; publishMutex_ must be held
+    void publishChunks(const std::map<size_t, std::shared_ptr<TaskStore>>& chunks, const std::vector<int>& ids);
+    // Adds an entry to the change log; publishMutex_ must be held
+    void recordChange(uint64_t version, int id, bool created);
+    // Makes a newly published version visible and wakes waitForVersion()
+    void publish(TaskSetPtr tasks);
+
+    std::vector<std::mutex> stripes_;
+    std::mutex publishMutex_;
+    TaskSetPtr current_;
+    std::atomic<int> nextId_{ 1 };
+    mutable std::mutex versionMutex_;
+    mutable std::condition_variable versionChanged_;
+
+    mutable std::mutex changesMutex_;
+    std::deque<Change> changes_;
+    size_t changeCapacity_ = 10000;
+    // Every change made after this version is still in changes_
+    uint64_t changesFloor_ = 0;
+};
+
+#endif // TASK_STORE_H
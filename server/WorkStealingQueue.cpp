@@ -0,0 +1,95 @@
+﻿#include "WorkStealingQueue.h"
+
+WorkStealingQueue::WorkStealingQueue(size_t workers) {
+    if (workers == 0) workers = 1;
+    for (size_t i = 0; i < workers; ++i) workers_.push_back(std::make_unique<Worker>());
+    for (size_t i = 0; i < workers; ++i) threads_.emplace_back([this, i] { run(i); });
+}
+
+WorkStealingQueue::~WorkStealingQueue() {
+    shutdown();
+}
+
+// Function to hand a job to the next worker in turn
+bool WorkStealingQueue::enqueue(std::function<void()> fn) {
+    if (shutdown_) return false;
+    Worker& worker = *workers_[nextWorker_.fetch_add(1, std::memory_order_relaxed) % workers_.size()];
+    size_t queued;
+    {
+        // Counted under the deque's lock so take() can never see the job uncounted
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.jobs.push_back(std::move(fn));
+        queued = ++queued_;
+    }
+    ++enqueued_;
+    size_t maxQueued = maxQueued_.load(std::memory_order_relaxed);
+    while (queued > maxQueued && !maxQueued_.compare_exchange_weak(maxQueued, queued, std::memory_order_relaxed)) {
+    }
+    // A worker about to sleep either sees queued_ above zero or is counted in
+    // sleeping_ here; taking idleMutex_ makes sure it is waiting before the notify
+    if (sleeping_ > 0) {
+        { std::lock_guard<std::mutex> lock(idleMutex_); }
+        idleCv_.notify_one();
+    }
+    return true;
+}
+
+void WorkStealingQueue::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(idleMutex_);
+        if (shutdown_.exchange(true)) return;
+    }
+    idleCv_.notify_all();
+    for (auto& thread : threads_) thread.join();
+}
+
+bool WorkStealingQueue::take(size_t worker, std::function<void()>& fn) {
+    Worker& from = *workers_[worker];
+    std::lock_guard<std::mutex> lock(from.mutex);
+    if (from.jobs.empty()) return false;
+    fn = std::move(from.jobs.front());
+    from.jobs.pop_front();
+    --queued_;
+    return true;
+}
+
+// Function run by each worker: own deque first, then the others, then sleep
+void WorkStealingQueue::run(size_t self) {
+    std::function<void()> fn;
+    for (;;) {
+        bool found = take(self, fn);
+        // Start with the next worker so thieves don't all pile onto worker 0
+        for (size_t i = 1; !found && i < workers_.size(); ++i) {
+            if (take((self + i) % workers_.size(), fn)) {
+                found = true;
+                ++stolen_;
+            }
+        }
+        if (found) {
+            fn();
+            fn = nullptr;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(idleMutex_);
+        ++sleeping_;
+        idleCv_.wait(lock, [this] { return queued_ > 0 || shutdown_; });
+        --sleeping_;
+        // Finish what was queued before shutdown() so no accepted connection is dropped
+        if (shutdown_ && queued_ == 0) return;
+    }
+}
+
+ExecutorStats WorkStealingQueue::stats() const {
+    ExecutorStats stats;
+    stats.workers = workers_.size();
+    stats.queued = queued_;
+    stats.maxQueued = maxQueued_;
+    stats.enqueued = enqueued_;
+    stats.stolen = stolen_;
+    for (const auto& worker : workers_) {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        stats.depths.push_back(worker->jobs.size());
+    }
+    return stats;
+}
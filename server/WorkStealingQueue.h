@@ -0,0 +1,76 @@
+﻿#ifndef WORK_STEALING_QUEUE_H
+#define WORK_STEALING_QUEUE_H
+
+#include "httplib.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Counters describing the work-stealing executor
+struct ExecutorStats {
+    size_t workers = 0;
+    // Jobs waiting in all deques right now, and the most ever seen at once
+    size_t queued = 0;
+    size_t maxQueued = 0;
+    uint64_t enqueued = 0;
+    // Jobs a worker took from another worker's deque
+    uint64_t stolen = 0;
+    // Jobs waiting in each worker's deque right now
+    std::vector<size_t> depths;
+};
+
+// Executor for httplib connections with one job deque per worker.
+// httplib's default ThreadPool keeps a single job list behind one mutex that
+// the acceptor and every worker fight over. Here the acceptor hands jobs out
+// round-robin, each worker takes jobs from its own deque, and a worker that
+// runs dry steals from the others before going to sleep. Stealing also keeps
+// a job from waiting behind a long-running one (such as an event stream).
+// Installed with httplib::Server::new_task_queue.
+class WorkStealingQueue : public httplib::TaskQueue {
+public:
+    explicit WorkStealingQueue(size_t workers);
+    ~WorkStealingQueue() override;
+
+    WorkStealingQueue(const WorkStealingQueue&) = delete;
+    WorkStealingQueue& operator=(const WorkStealingQueue&) = delete;
+
+    bool enqueue(std::function<void()> fn) override;
+    // Runs every job already queued, then stops and joins the workers
+    void shutdown() override;
+
+    ExecutorStats stats() const;
+
+private:
+    // Kept on its own cache line so workers don't slow each other down
+    struct alignas(64) Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> jobs;
+    };
+
+    void run(size_t self);
+    // Takes the oldest job from a worker's deque, returns false if it is empty
+    bool take(size_t worker, std::function<void()>& fn);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> nextWorker_{ 0 };
+
+    // Jobs in all deques; workers only sleep while it is zero
+    std::atomic<size_t> queued_{ 0 };
+    std::atomic<size_t> maxQueued_{ 0 };
+    std::atomic<uint64_t> enqueued_{ 0 };
+    std::atomic<uint64_t> stolen_{ 0 };
+
+    std::mutex idleMutex_;
+    std::condition_variable idleCv_;
+    std::atomic<size_t> sleeping_{ 0 };
+    std::atomic<bool> shutdown_{ false };
+};
+
+#endif // WORK_STEALING_QUEUE_H
@@ -0,0 +1,236 @@
+﻿#include "Log.h"
+#include <cstdint>
+#include <ctime>
+#include <stdexcept>
+#include <utility>
+
+// The process-wide logger used by the LOG_* macros
+Logger logger;
+
+// How long queued records may wait before the writer thread picks them up; errors wake it at once
+static const std::chrono::milliseconds FLUSH_INTERVAL(20);
+
+LogLevel parseLogLevel(const std::string& name) {
+    if (name == "debug") return LogLevel::Debug;
+    if (name == "info") return LogLevel::Info;
+    if (name == "warn") return LogLevel::Warn;
+    if (name == "error") return LogLevel::Error;
+    throw std::invalid_argument("Unknown log level: " + name);
+}
+
+// Function to append a field value, quoted if it would not read back as one token
+static void appendValue(std::string& out, const std::string& value) {
+    bool plain = !value.empty();
+    for (char c : value) {
+        if (c == ' ' || c == '"' || c == '=' || c == '\\' || static_cast<unsigned char>(c) < 0x20) {
+            plain = false;
+            break;
+        }
+    }
+    if (plain) {
+        out += value;
+        return;
+    }
+    out += '"';
+    for (char c : value) {
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default: out += c;
+        }
+    }
+    out += '"';
+}
+
+// Function to append a record as one line: UTC timestamp, level, message and fields
+static void appendLine(std::string& out, std::chrono::system_clock::time_point time, LogLevel level, const std::string& text) {
+    static const char* const LEVEL_NAMES[] = { "DEBUG", "INFO ", "WARN ", "ERROR" };
+    auto sinceEpoch = time.time_since_epoch();
+    std::time_t seconds = std::chrono::duration_cast<std::chrono::seconds>(sinceEpoch).count();
+    int millis = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(sinceEpoch).count() % 1000);
+    std::tm utc{};
+#ifdef _WIN32
+    gmtime_s(&utc, &seconds);
+#else
+    gmtime_r(&seconds, &utc);
+#endif
+    char stamp[32];
+    size_t length = std::strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &utc);
+    std::snprintf(stamp + length, sizeof(stamp) - length, ".%03dZ ", millis);
+    out += stamp;
+    out += LEVEL_NAMES[static_cast<size_t>(level)];
+    out += ' ';
+    out += text;
+    out += '\n';
+}
+
+Logger::Logger() : slots_(new Slot[CAPACITY]) {
+    for (size_t i = 0; i < CAPACITY; ++i) slots_[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+Logger::~Logger() {
+    stop();
+}
+
+bool Logger::start(const LogOptions& options) {
+    {
+        std::lock_guard<std::mutex> lock(outputMutex_);
+        options_ = options;
+        if (!options_.file.empty()) {
+            file_ = std::fopen(options_.file.c_str(), "ab");
+            if (!file_) return false;
+            std::fseek(file_, 0, SEEK_END);
+            long size = std::ftell(file_);
+            fileBytes_ = size > 0 ? static_cast<size_t>(size) : 0;
+        }
+    }
+    level_ = options.level;
+    std::lock_guard<std::mutex> lock(wakeMutex_);
+    if (running_) return true;
+    stopping_ = false;
+    running_ = true;
+    writer_ = std::thread([this] { writerLoop(); });
+    return true;
+}
+
+void Logger::stop() {
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex_);
+        if (!running_) return;
+        stopping_ = true;
+    }
+    wakeCv_.notify_one();
+    writer_.join();
+    running_ = false;
+
+    // Records pushed while the writer was finishing; this thread is the only reader now
+    std::string batch;
+    Record record;
+    while (pop(record)) appendLine(batch, record.time, record.level, record.text);
+    if (!batch.empty()) output(batch);
+    std::lock_guard<std::mutex> lock(outputMutex_);
+    if (file_) std::fclose(file_);
+    file_ = nullptr;
+}
+
+void Logger::write(LogLevel level, const std::string& message, std::initializer_list<LogField> fields) {
+    Record record;
+    record.time = std::chrono::system_clock::now();
+    record.level = level;
+    record.text = message;
+    for (const LogField& field : fields) {
+        record.text += ' ';
+        record.text += field.key;
+        record.text += '=';
+        appendValue(record.text, field.value);
+    }
+
+    if (running_ && push(std::move(record))) {
+        if (level >= LogLevel::Error) {
+            wakeRequested_ = true;
+            wakeCv_.notify_one();
+        }
+        return;
+    }
+    // Errors are never dropped: with the ring full they are written right away, ahead of what is queued
+    if (running_ && level < LogLevel::Error) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    std::string line;
+    appendLine(line, record.time, record.level, record.text);
+    output(line);
+}
+
+// Bounded multi-producer queue after Dmitry Vyukov's design: a producer
+// claims a position with one CAS on head_, and each slot's sequence number
+// tells whether it is free (== position) or filled (== position + 1)
+bool Logger::push(Record&& record) {
+    size_t position = head_.load(std::memory_order_relaxed);
+    for (;;) {
+        Slot& slot = slots_[position & (CAPACITY - 1)];
+        size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+        if (difference == 0) {
+            if (head_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                slot.record = std::move(record);
+                slot.sequence.store(position + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (difference < 0) {
+            // The writer has not freed this slot yet: the ring is full
+            return false;
+        }
+        else {
+            position = head_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool Logger::pop(Record& record) {
+    Slot& slot = slots_[tail_ & (CAPACITY - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != tail_ + 1) return false;
+    record = std::move(slot.record);
+    slot.sequence.store(tail_ + CAPACITY, std::memory_order_release);
+    ++tail_;
+    return true;
+}
+
+// Writer thread: wakes every FLUSH_INTERVAL (or on an error) and writes everything queued at once
+void Logger::writerLoop() {
+    std::string batch;
+    Record record;
+    for (;;) {
+        bool stopping;
+        {
+            std::unique_lock<std::mutex> lock(wakeMutex_);
+            wakeCv_.wait_for(lock, FLUSH_INTERVAL, [this] { return stopping_ || wakeRequested_; });
+            wakeRequested_ = false;
+            stopping = stopping_;
+        }
+
+        batch.clear();
+        while (pop(record)) appendLine(batch, record.time, record.level, record.text);
+        uint64_t dropped = dropped_.exchange(0, std::memory_order_relaxed);
+        if (dropped) {
+            appendLine(batch, std::chrono::system_clock::now(), LogLevel::Warn,
+                "Log records dropped, the queue was full count=" + std::to_string(dropped));
+        }
+        if (!batch.empty()) output(batch);
+        if (stopping) return;
+    }
+}
+
+void Logger::output(const std::string& text) {
+    std::lock_guard<std::mutex> lock(outputMutex_);
+    if (options_.console) {
+        std::fwrite(text.data(), 1, text.size(), stderr);
+        std::fflush(stderr);
+    }
+    if (file_) {
+        std::fwrite(text.data(), 1, text.size(), file_);
+        std::fflush(file_);
+        fileBytes_ += text.size();
+        if (fileBytes_ >= options_.maxFileBytes) rotate();
+    }
+}
+
+// Function to move <file> to <file>.1, <file>.1 to <file>.2 and so on, dropping the oldest
+void Logger::rotate() {
+    std::fclose(file_);
+    const std::string& path = options_.file;
+    if (options_.maxFiles > 0) {
+        std::remove((path + "." + std::to_string(options_.maxFiles)).c_str());
+        for (size_t i = options_.maxFiles - 1; i >= 1; --i) {
+            std::rename((path + "." + std::to_string(i)).c_str(), (path + "." + std::to_string(i + 1)).c_str());
+        }
+        std::rename(path.c_str(), (path + ".1").c_str());
+    }
+    // Without old files to keep, start the file over
+    file_ = std::fopen(path.c_str(), options_.maxFiles > 0 ? "ab" : "wb");
+    fileBytes_ = 0;
+}
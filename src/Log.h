@@ -0,0 +1,144 @@
+﻿#ifndef LOG_H
+#define LOG_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+// Severity of a log record, in increasing order
+enum class LogLevel : uint8_t {
+    Debug = 0,
+    Info = 1,
+    Warn = 2,
+    Error = 3
+};
+
+// Lowest level compiled in: LOG_DEBUG calls below it vanish along with their
+// arguments. Defaults to Debug, or Info when NDEBUG is defined.
+#ifndef LOG_COMPILED_LEVEL
+#ifdef NDEBUG
+#define LOG_COMPILED_LEVEL 1
+#else
+#define LOG_COMPILED_LEVEL 0
+#endif
+#endif
+
+// A key=value pair attached to a log record
+struct LogField {
+    LogField(const char* key, std::string value) : key(key), value(std::move(value)) {}
+    LogField(const char* key, const char* value) : key(key), value(value) {}
+    template <typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value>::type>
+    LogField(const char* key, T value) : key(key), value(std::to_string(value)) {}
+
+    const char* key;
+    std::string value;
+};
+
+// Where records go and which are kept
+struct LogOptions {
+    // Records below this level are dropped at runtime
+    LogLevel level = LogLevel::Info;
+    // Write records to stderr
+    bool console = true;
+    // Also append them to this file if not empty, rotating it to <file>.1 ... <file>.<maxFiles>
+    std::string file;
+    size_t maxFileBytes = 10 * 1024 * 1024;
+    size_t maxFiles = 5;
+};
+
+// Asynchronous structured logger.
+// Logging used to mean a std::cout << ... << std::endl per line: the stream
+// lock and a flush on every request. Here the calling thread only formats
+// the record (message plus key=value fields) and pushes it into a bounded
+// lock-free ring; a background thread takes the timestamp formatting and
+// the I/O, writing everything queued with one write and one flush. When the
+// ring is full records are dropped rather than blocking, and a count of
+// them is logged once there is room again; errors are written straight away
+// instead. So are records written before start() or after stop().
+class Logger {
+public:
+    Logger();
+    ~Logger();
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    // Starts the writer thread; returns false if the log file could not be opened
+    bool start(const LogOptions& options);
+    // Writes everything queued and stops the writer thread
+    void stop();
+
+    bool enabled(LogLevel level) const {
+        return level >= level_.load(std::memory_order_relaxed);
+    }
+    void write(LogLevel level, const std::string& message, std::initializer_list<LogField> fields = {});
+
+private:
+    struct Record {
+        std::chrono::system_clock::time_point time;
+        LogLevel level = LogLevel::Info;
+        std::string text;
+    };
+    // One ring position; sequence says whether it is free or holds a record for the writer
+    struct alignas(64) Slot {
+        std::atomic<size_t> sequence{ 0 };
+        Record record;
+    };
+
+    static const size_t CAPACITY = 8192;
+
+    bool push(Record&& record);
+    bool pop(Record& record);
+    void writerLoop();
+    // Appends records to the outputs and flushes them; called by one thread at a time
+    void output(const std::string& text);
+    void rotate();
+
+    std::unique_ptr<Slot[]> slots_;
+    alignas(64) std::atomic<size_t> head_{ 0 };
+    alignas(64) size_t tail_ = 0;
+    std::atomic<uint64_t> dropped_{ 0 };
+    std::atomic<LogLevel> level_{ LogLevel::Info };
+
+    LogOptions options_;
+    std::FILE* file_ = nullptr;
+    size_t fileBytes_ = 0;
+    std::mutex outputMutex_;
+
+    std::mutex wakeMutex_;
+    std::condition_variable wakeCv_;
+    std::atomic<bool> wakeRequested_{ false };
+    std::atomic<bool> running_{ false };
+    bool stopping_ = false;
+    std::thread writer_;
+};
+
+// The process-wide logger used by the LOG_* macros
+extern Logger logger;
+
+// Function to parse "debug", "info", "warn" or "error"; throws std::invalid_argument otherwise
+LogLevel parseLogLevel(const std::string& name);
+
+#define LOG_AT(level, ...) \
+    do { if (logger.enabled(level)) logger.write(level, __VA_ARGS__); } while (0)
+
+#if LOG_COMPILED_LEVEL <= 0
+#define LOG_DEBUG(...) LOG_AT(LogLevel::Debug, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
+#define LOG_INFO(...) LOG_AT(LogLevel::Info, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LogLevel::Warn, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LogLevel::Error, __VA_ARGS__)
+
+#endif // LOG_H
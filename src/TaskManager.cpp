@@ -1,40 +1,310 @@
 ﻿#include "TaskManager.h"
+#include "Log.h"
 #include "httplib.h"
 #include "json.hpp"
+#include "WireFormat.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <thread>
 #include <unordered_map>
+#include <utility>
 #include <mutex>
-#include <iostream>
 
 // Using an unordered map to store tasks with their IDs as keys
 std::unordered_map<int, Task> tasks;
 // Mutex to ensure thread-safe access to the tasks map
 std::mutex tasksMutex;
+// ETag of the task list currently held in the map, sent back as If-None-Match
+std::string tasksETag;
+// Server run and store version of the data in the map. Unlike tasksETag it is
+// not cleared to force a reload, so a response or event computed before the
+// data already applied can always be recognised and dropped.
+std::pair<uint64_t, uint64_t> tasksVersion{ 0, 0 };
 // Server URL for connecting to the backend
 const std::string SERVER_URL = "http://localhost:8080";
 
-// Function to load tasks from the server
+// Function to read an ETag or event ID ("<epoch>-<version>", quotes optional)
+// as a (server run, version) pair. The epoch is the server's start time, so
+// pairs compare in the order the server produced them, across restarts too.
+bool parseTasksVersion(std::string tag, std::pair<uint64_t, uint64_t>& version) {
+    tag.erase(std::remove(tag.begin(), tag.end(), '"'), tag.end());
+    size_t dash = tag.rfind('-');
+    if (dash == std::string::npos || dash == 0 || dash + 1 == tag.size()) return false;
+    version.first = std::strtoull(tag.c_str(), nullptr, 10);
+    version.second = std::strtoull(tag.c_str() + dash + 1, nullptr, 10);
+    return true;
+}
+
+// Function to decide whether data tagged with an ETag or event ID may be
+// applied to the map. Returns false if the map already holds a newer
+// version; otherwise records the tag's version as the map's. Data at the
+// version already held is let through: it describes the same state, and a
+// reload after a reset (which keeps the version) must not be refused. Call
+// with tasksMutex held.
+bool advanceTasksVersion(const std::string& tag) {
+    std::pair<uint64_t, uint64_t> version;
+    // Untagged data cannot be placed, apply it as before
+    if (!parseTasksVersion(tag, version)) return true;
+    if (version < tasksVersion) return false;
+    tasksVersion = version;
+    return true;
+}
+
+// Number of tasks fetched per request on a full load
+const int TASK_PAGE_SIZE = 1000;
+
+// Function to build the headers sent with every task list request
+httplib::Headers taskListHeaders() {
+    httplib::Headers headers;
+    // Binary bodies are smaller and cheaper to parse; servers without them answer in JSON
+    headers.emplace("Accept", "application/cbor, application/msgpack;q=0.9, application/json;q=0.5");
+    // No Accept-Encoding: built with CPPHTTPLIB_ZLIB_SUPPORT, httplib already
+    // asks for gzip/deflate and inflates the body transparently
+    return headers;
+}
+
+// Function to fetch every task from the server one page at a time.
+// Later pages may already reflect newer versions, so the map is tagged with
+// the ETag of the first page; the next delta sync then catches up on
+// anything that changed while the pages were being fetched.
+bool loadTaskPages(httplib::Client& cli, std::unordered_map<int, Task>& loaded, std::string& etag) {
+    std::string cursor;
+    do {
+        std::string path = "/tasks?limit=" + std::to_string(TASK_PAGE_SIZE);
+        if (!cursor.empty()) path += "&cursor=" + cursor;
+        auto res = cli.Get(path, taskListHeaders());
+        if (!res || res->status != 200) return false;
+        if (etag.empty()) etag = res->get_header_value("ETag");
+
+        TaskDocument page = readTaskDocument(res->body, wireFormatFromContentType(res->get_header_value("Content-Type")));
+        for (auto& task : page.tasks) {
+            loaded[task.id] = std::move(task);
+        }
+        cursor = page.nextCursor;
+    } while (!cursor.empty());
+    return true;
+}
+
+// Function to load tasks from the server.
+// The first load pages through the whole list. After that only the changes
+// made since the version in the map are fetched and applied in place; the
+// server sends everything instead if it no longer remembers that version.
 void loadTasksFromServer() {
     // Create an HTTP client pointing to the server
     httplib::Client cli(SERVER_URL.c_str());
-    // Send a GET request to fetch all tasks
-    auto res = cli.Get("/tasks");
-    if (res && res->status == 200) {
-        // Parse the JSON response
-        auto jTasks = nlohmann::json::parse(res->body);
+    // Ask the server to skip the body if our copy is still current
+    httplib::Headers headers = taskListHeaders();
+    std::string path = "/tasks";
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex);
+        if (!tasksETag.empty()) {
+            headers.emplace("If-None-Match", tasksETag);
+            // The sync token is the ETag without its quotes
+            std::string token = tasksETag;
+            token.erase(std::remove(token.begin(), token.end(), '"'), token.end());
+            path += "?since=" + token;
+        }
+    }
+    if (path == "/tasks") {
+        std::unordered_map<int, Task> loaded;
+        std::string etag;
+        if (!loadTaskPages(cli, loaded, etag)) {
+            // Log an error if any page failed
+            LOG_ERROR("Could not load tasks from server");
+            return;
+        }
+        // Lock the tasks map and swap in the freshly loaded tasks
+        std::lock_guard<std::mutex> lock(tasksMutex);
+        if (!advanceTasksVersion(etag)) {
+            // The change feed moved the map past these pages while they were fetched
+            LOG_DEBUG("Dropped a task list older than the one held", { { "etag", etag } });
+            return;
+        }
+        tasks.swap(loaded);
+        tasksETag = etag;
+        LOG_INFO("Tasks loaded from server", { { "tasks", tasks.size() } });
+        return;
+    }
+    // Send a GET request to fetch the tasks (or the changes to them)
+    auto res = cli.Get(path, headers);
+    if (res && res->status == 304) {
+        // Nothing changed since the last load, keep the current map
+        LOG_DEBUG("Tasks unchanged on server");
+    }
+    else if (res && res->status == 200) {
+        // Parse the response in whichever format the server picked. It holds
+        // either the changes since our version or, if that is too old, every task
+        TaskDocument document = readTaskDocument(res->body, wireFormatFromContentType(res->get_header_value("Content-Type")));
+        bool delta = !document.full;
+        std::string etag = res->get_header_value("ETag");
         // Lock the tasks map for thread-safe access
         std::lock_guard<std::mutex> lock(tasksMutex);
-        tasks.clear(); // Clear the existing tasks before loading new ones
-        // Iterate through the JSON object and populate the tasks map
-        for (const auto& [id, taskJson] : jTasks.items()) {
-            Task task = Task::from_json(taskJson); // Convert JSON to Task object
-            tasks[std::stoi(id)] = task;          // Add the task to the map
+        if (!advanceTasksVersion(etag)) {
+            // The change feed already applied newer changes than this response holds
+            LOG_DEBUG("Dropped a task list older than the one held", { { "etag", etag } });
+            return;
         }
-        std::cout << "Tasks loaded from server successfully!" << std::endl;
+        if (!delta) tasks.clear(); // Clear the existing tasks before loading new ones
+        tasksETag.clear();
+        // Add or replace the tasks in the map
+        for (auto& task : document.tasks) {
+            tasks[task.id] = std::move(task);
+        }
+        // Drop the tasks deleted on the server
+        for (int id : document.deleted) {
+            tasks.erase(id);
+        }
+        // Remember which version the map now holds
+        tasksETag = etag;
+        LOG_INFO(delta ? "Task changes loaded from server" : "Tasks loaded from server", { { "tasks", tasks.size() } });
     }
     else {
         // Log an error if the request failed
-        std::cerr << "Error: Could not load tasks from server." << std::endl;
+        LOG_ERROR("Could not load tasks from server");
+    }
+}
+
+// Background thread following GET /tasks/events, and what it needs to stop
+std::thread eventListener;
+std::atomic<bool> eventListenerStopping{ false };
+std::mutex eventClientMutex;
+std::condition_variable eventListenerWake;
+httplib::Client* eventClient = nullptr;
+
+// One change event from GET /tasks/events
+struct TaskEvent {
+    std::string type;
+    std::string data;
+};
+
+// Function to apply one batch of change events to the tasks map.
+// The server gives only a batch's last event an ID, the version the whole
+// batch brings the map to, so the listener collects events until that one
+// arrives. The batch is then checked against the map's version once and
+// applied or dropped as a unit under one lock: a reload may have brought
+// the map past it while it was in flight. Throws on a malformed event,
+// before the map is touched.
+void applyTaskEvents(const std::vector<TaskEvent>& events, const std::string& id) {
+    std::vector<Task> changed;
+    std::vector<int> deleted;
+    for (const TaskEvent& event : events) {
+        if (event.type == "create" || event.type == "update") {
+            changed.push_back(Task::from_json(nlohmann::json::parse(event.data)));
+        }
+        else if (event.type == "delete") {
+            deleted.push_back(nlohmann::json::parse(event.data).at("id").get<int>());
+        }
+    }
+    std::lock_guard<std::mutex> lock(tasksMutex);
+    if (!advanceTasksVersion(id)) return;
+    for (auto& task : changed) tasks[task.id] = std::move(task);
+    for (int taskId : deleted) tasks.erase(taskId);
+    // The event ID is the version the map now holds, in ETag form for the next sync
+    tasksETag = "\"" + id + "\"";
+}
+
+// Function to follow the server's change feed until stopTaskEventListener() is called.
+// Every connection resumes from the version in the map, so nothing is missed
+// while reconnecting; a "reset" event triggers a reload before continuing.
+void runTaskEventListener() {
+    auto retryDelay = std::chrono::milliseconds(3000);
+    while (!eventListenerStopping) {
+        std::string lastEventId;
+        {
+            std::lock_guard<std::mutex> lock(tasksMutex);
+            lastEventId = tasksETag;
+        }
+        if (lastEventId.empty()) {
+            // Events only make sense on top of a loaded map
+            loadTasksFromServer();
+        }
+        else {
+            lastEventId.erase(std::remove(lastEventId.begin(), lastEventId.end(), '"'), lastEventId.end());
+            httplib::Client cli(SERVER_URL.c_str());
+            {
+                std::lock_guard<std::mutex> lock(eventClientMutex);
+                if (eventListenerStopping) break;
+                eventClient = &cli;
+            }
+            // Parse the stream line by line; a blank line ends an event
+            std::string buffer, type, data, id;
+            std::vector<TaskEvent> batch;
+            bool reset = false;
+            cli.Get("/tasks/events", { {"Last-Event-ID", lastEventId} },
+                [&](const char* bytes, size_t length) {
+                    buffer.append(bytes, length);
+                    size_t end;
+                    while ((end = buffer.find('\n')) != std::string::npos) {
+                        std::string line = buffer.substr(0, end);
+                        buffer.erase(0, end + 1);
+                        if (!line.empty() && line.back() == '\r') line.pop_back();
+                        if (line.empty()) {
+                            try {
+                                // A reset means the map has to be reloaded; other events wait for their batch's ID
+                                if (type == "reset") reset = true;
+                                else if (type == "create" || type == "update" || type == "delete") batch.push_back({ type, data });
+                                if (!reset && !batch.empty() && !id.empty()) {
+                                    applyTaskEvents(batch, id);
+                                    batch.clear();
+                                }
+                            }
+                            catch (const std::exception& e) {
+                                // A malformed event leaves the map unreliable, so reload it
+                                LOG_ERROR("Bad task event", { { "type", type }, { "error", e.what() } });
+                                reset = true;
+                            }
+                            type.clear();
+                            data.clear();
+                            id.clear();
+                        }
+                        else if (line.rfind("event: ", 0) == 0) type = line.substr(7);
+                        else if (line.rfind("data: ", 0) == 0) data += line.substr(6);
+                        else if (line.rfind("id: ", 0) == 0) id = line.substr(4);
+                        else if (line.rfind("retry: ", 0) == 0) retryDelay = std::chrono::milliseconds(std::atoi(line.c_str() + 7));
+                    }
+                    // Reconnect with a fresh map after a reset, stop when asked to
+                    return !reset && !eventListenerStopping;
+                });
+            {
+                std::lock_guard<std::mutex> lock(eventClientMutex);
+                eventClient = nullptr;
+            }
+            if (reset) {
+                // Forget our version so the next load fetches everything
+                {
+                    std::lock_guard<std::mutex> lock(tasksMutex);
+                    tasksETag.clear();
+                }
+                continue;
+            }
+        }
+        // Wait before reconnecting, unless asked to stop in the meantime
+        std::unique_lock<std::mutex> lock(eventClientMutex);
+        eventListenerWake.wait_for(lock, retryDelay, [] { return eventListenerStopping.load(); });
+    }
+}
+
+// Function to start keeping the tasks map current from the server's change feed
+void startTaskEventListener() {
+    if (eventListener.joinable()) return;
+    eventListenerStopping = false;
+    eventListener = std::thread(runTaskEventListener);
+}
+
+// Function to stop the change feed listener and wait for its thread
+void stopTaskEventListener() {
+    if (!eventListener.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(eventClientMutex);
+        eventListenerStopping = true;
+        // Closing the socket ends a request that is waiting for the next event
+        if (eventClient) eventClient->stop();
     }
+    eventListenerWake.notify_all();
+    eventListener.join();
 }
 
 // Function to save a task to the server
@@ -46,12 +316,39 @@ void saveTaskToServer(const Task& task) {
     // Send a POST request with the task JSON
     auto res = cli.Post("/tasks", jTask.dump(), "application/json");
     if (res && res->status == 200) {
-        std::cout << "Task saved to server successfully!" << std::endl;
+        LOG_INFO("Task saved to server");
+    }
+    else {
+        // Log an error if the request failed
+        LOG_ERROR("Could not save task to server");
+    }
+}
+
+// Function to save many new tasks to the server with a single batch request
+std::vector<int> saveTasksToServer(const std::vector<Task>& newTasks) {
+    std::vector<int> ids;
+    if (newTasks.empty()) return ids;
+    // Create an HTTP client pointing to the server
+    httplib::Client cli(SERVER_URL.c_str());
+    // Describe every task as a create operation
+    nlohmann::json jOperations = nlohmann::json::array();
+    for (const auto& task : newTasks) {
+        jOperations.push_back({ {"op", "create"}, {"description", task.description} });
+    }
+    // Send one POST request carrying all of them
+    auto res = cli.Post("/tasks/batch", jOperations.dump(), "application/json");
+    if (res && res->status == 200) {
+        auto jResponse = nlohmann::json::parse(res->body);
+        for (const auto& jResult : jResponse["results"]) {
+            ids.push_back(jResult.value("status", 0) == 200 ? jResult.value("id", 0) : 0);
+        }
+        LOG_INFO("Tasks saved to server", { { "tasks", ids.size() } });
     }
     else {
         // Log an error if the request failed
-        std::cerr << "Error: Could not save task to server." << std::endl;
+        LOG_ERROR("Could not save tasks to server", { { "tasks", newTasks.size() } });
     }
+    return ids;
 }
 
 // Function to delete a task from the server
@@ -63,11 +360,11 @@ void deleteTaskFromServer(int id) {
     // Send a DELETE request to the server
     auto res = cli.Delete(url.c_str());
     if (res && res->status == 200) {
-        std::cout << "Task deleted from server successfully!" << std::endl;
+        LOG_INFO("Task deleted from server", { { "id", id } });
     }
     else {
         // Log an error if the request failed
-        std::cerr << "Error: Could not delete task from server." << std::endl;
+        LOG_ERROR("Could not delete task from server", { { "id", id } });
     }
 }
 
@@ -81,17 +378,17 @@ void updateTaskInServer(const Task& task) {
     nlohmann::json jTask = task.to_json();
 
     // Log the update request being sent
-    std::cout << "📤 Sending Update Request: " << jTask.dump() << std::endl;
+    LOG_DEBUG("Sending update request", { { "id", task.id }, { "body", jTask.dump() } });
 
     // Send a PUT request with the task JSON
     auto res = cli.Put(url.c_str(), jTask.dump(), "application/json");
 
     if (res && res->status == 200) {
-        std::cout << "✅ Task updated successfully on server!" << std::endl;
+        LOG_INFO("Task updated on server", { { "id", task.id } });
     }
     else {
         // Log an error if the request failed and include server response (if any)
-        std::cerr << "❌ Error updating task! Response: " << (res ? res->body : "No Response") << std::endl;
+        LOG_ERROR("Could not update task on server", { { "id", task.id }, { "response", res ? res->body : "No Response" } });
     }
 }
 
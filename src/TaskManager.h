@@ -7,8 +7,13 @@
 
 void loadTasksFromServer();
 void saveTaskToServer(const Task& task);
+// Creates many tasks in one request, returns the IDs assigned to them (empty if the request failed)
+std::vector<int> saveTasksToServer(const std::vector<Task>& newTasks);
 void deleteTaskFromServer(int id);
 void updateTaskInServer(const Task& task); // Add this declaration
+// Keeps the task list current from the server's change feed on a background thread
+void startTaskEventListener();
+void stopTaskEventListener();
 
 std::vector<Task> getAllTasks();
 
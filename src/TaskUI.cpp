@@ -9,7 +9,7 @@
 #include <vector>
 #include <unordered_map>
 #include "Task.h"
-#include <iostream>
+#include "Log.h"
 
 // Global variable to store the main application window
 static GLFWwindow* window = nullptr;
@@ -17,11 +17,26 @@ static GLFWwindow* window = nullptr;
 // Map to store edit buffers for each task, used for updating task descriptions
 static std::unordered_map<int, std::string> editBuffers;
 
+// Function to turn the text typed into the add box into tasks, one per non-empty line
+static std::vector<Task> splitTaskLines(const std::string& text) {
+    std::vector<Task> newTasks;
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t end = text.find('\n', start);
+        if (end == std::string::npos) end = text.size();
+        std::string line = text.substr(start, end - start);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.find_first_not_of(" \t") != std::string::npos) newTasks.push_back({ 0, line });
+        start = end + 1;
+    }
+    return newTasks;
+}
+
 // Function to initialize the UI
 void initializeUI() {
-    std::cout << "Initializing GLFW..." << std::endl;
+    LOG_DEBUG("Initializing GLFW");
     if (!glfwInit()) throw std::runtime_error("Failed to initialize GLFW");
-    std::cout << "GLFW initialized." << std::endl;
+    LOG_DEBUG("GLFW initialized");
 
     // Set OpenGL version and profile
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -34,7 +49,7 @@ void initializeUI() {
         glfwTerminate();
         throw std::runtime_error("Failed to create GLFW window");
     }
-    std::cout << "Window created successfully." << std::endl;
+    LOG_DEBUG("Window created");
 
     // Set the current OpenGL context and enable vsync
     glfwMakeContextCurrent(window);
@@ -47,16 +62,18 @@ void initializeUI() {
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init("#version 330");
 
-    std::cout << "UI initialized successfully." << std::endl;
+    LOG_INFO("UI initialized");
 
     // Load tasks from the server at startup
     try {
         loadTasksFromServer();
-        std::cout << "Tasks loaded successfully." << std::endl;
+        LOG_DEBUG("Tasks loaded");
     }
     catch (const std::exception& e) {
-        std::cerr << "Error loading tasks: " << e.what() << std::endl;
+        LOG_ERROR("Could not load tasks", { { "error", e.what() } });
     }
+    // Pick up changes made by other users as they happen
+    startTaskEventListener();
 }
 
 // Function to render the UI in a loop
@@ -85,15 +102,20 @@ void renderUI() {
         ImGui::PopFont();
         ImGui::Separator();
 
-        // Section to add a new task
-        static char taskDescription[256] = "";
-        ImGui::InputText("##TaskDescription", taskDescription, IM_ARRAYSIZE(taskDescription));
+        // Section to add new tasks, one per line
+        static char taskDescription[4096] = "";
+        ImGui::InputTextMultiline("##TaskDescription", taskDescription, IM_ARRAYSIZE(taskDescription),
+            ImVec2(ImGui::GetContentRegionAvail().x - 110, 60));
         ImGui::SameLine();
         if (ImGui::Button("Add Task", ImVec2(100, 30))) {
-            std::string trimmedTask = std::string(taskDescription);
-            if (!trimmedTask.empty()) {
-                Task newTask = { 0, trimmedTask };
-                saveTaskToServer(newTask); // Save the task to the server
+            std::vector<Task> newTasks = splitTaskLines(taskDescription);
+            if (newTasks.size() == 1) {
+                saveTaskToServer(newTasks[0]); // Save the task to the server
+            }
+            else if (newTasks.size() > 1) {
+                saveTasksToServer(newTasks); // Save them all with one batch request
+            }
+            if (!newTasks.empty()) {
                 memset(taskDescription, 0, sizeof(taskDescription)); // Clear the input field
                 loadTasksFromServer(); // Reload tasks to update the UI
             }
@@ -122,7 +144,7 @@ void renderUI() {
 
             if (ImGui::InputText(("##EditTask" + std::to_string(task.id)).c_str(), buffer, sizeof(buffer))) {
                 editBuffers[task.id] = std::string(buffer);
-                std::cout << "✍️ Edit Buffer Updated for Task " << task.id << ": " << editBuffers[task.id] << std::endl;
+                LOG_DEBUG("Edit buffer updated", { { "id", task.id }, { "buffer", editBuffers[task.id] } });
             }
 
             ImGui::Spacing();
@@ -140,14 +162,14 @@ void renderUI() {
                 std::string newDescription = editBuffers[task.id];
 
                 if (newDescription != task.description) {
-                    std::cout << "🔄 Updating task " << task.id << " from '" << task.description << "' to '" << newDescription << "'" << std::endl;
+                    LOG_DEBUG("Updating task", { { "id", task.id }, { "from", task.description }, { "to", newDescription } });
 
                     task.description = newDescription;  // Update the task locally
                     updateTaskInServer(task);          // Send the update to the server
                     loadTasksFromServer();            // Reload tasks to refresh the UI
                 }
                 else {
-                    std::cout << "⚠️ No changes detected. Skipping update." << std::endl;
+                    LOG_DEBUG("No changes, skipping update", { { "id", task.id } });
                 }
             }
 
@@ -167,11 +189,12 @@ void renderUI() {
 
 // Function to clean up resources when the UI is closed
 void cleanupUI() {
-    std::cout << "Cleaning up UI..." << std::endl;
+    LOG_DEBUG("Cleaning up UI");
+    stopTaskEventListener();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
     glfwDestroyWindow(window);
     glfwTerminate();
-    std::cout << "UI cleanup complete." << std::endl;
+    LOG_DEBUG("UI cleanup complete");
 }
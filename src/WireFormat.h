@@ -0,0 +1,224 @@
+#ifndef WIRE_FORMAT_H
+#define WIRE_FORMAT_H
+
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "json.hpp"
+#include "Task.h"
+
+// Encodings a task payload can travel in, shared by the server and the client.
+// JSON is the default; MessagePack and CBOR carry the same documents in a
+// binary form that is smaller and much cheaper to parse.
+enum class WireFormat {
+    Json,
+    MsgPack,
+    Cbor
+};
+
+inline const char* wireFormatContentType(WireFormat format) {
+    switch (format) {
+    case WireFormat::MsgPack: return "application/msgpack";
+    case WireFormat::Cbor: return "application/cbor";
+    default: return "application/json";
+    }
+}
+
+// Function to reduce a Content-Type value or Accept entry to its media type:
+// parameters dropped, surrounding whitespace trimmed and lowercased
+inline std::string mediaTypeOf(const std::string& value) {
+    std::string type = value.substr(0, value.find(';'));
+    size_t first = type.find_first_not_of(" \t");
+    if (first == std::string::npos) return std::string();
+    type = type.substr(first, type.find_last_not_of(" \t") - first + 1);
+    for (char& c : type) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return type;
+}
+
+// Function to map a Content-Type header onto a format, JSON if it is not a binary one
+inline WireFormat wireFormatFromContentType(const std::string& contentType) {
+    std::string type = mediaTypeOf(contentType);
+    if (type == "application/msgpack" || type == "application/x-msgpack" || type == "application/vnd.msgpack") {
+        return WireFormat::MsgPack;
+    }
+    if (type == "application/cbor") return WireFormat::Cbor;
+    return WireFormat::Json;
+}
+
+// Function to pick the response format from an Accept header.
+// Each format's q-value comes from its own entry, else from application/*,
+// else from */*. The highest non-zero one wins: JSON on a tie, otherwise
+// the binary type listed first. JSON is also the answer when nothing
+// acceptable is listed, since every client can read it.
+inline WireFormat negotiateWireFormat(const std::string& accept) {
+    // Per format: q-value from its own entry (-1 if not listed) and where that entry was
+    double quality[3] = { -1, -1, -1 };
+    size_t listedAt[3] = { SIZE_MAX, SIZE_MAX, SIZE_MAX };
+    double applicationAny = -1;
+    double any = -1;
+    size_t index = 0;
+    size_t pos = 0;
+    while (pos < accept.size()) {
+        size_t end = accept.find(',', pos);
+        if (end == std::string::npos) end = accept.size();
+        std::string entry = accept.substr(pos, end - pos);
+        pos = end + 1;
+
+        std::string type = mediaTypeOf(entry);
+        if (type.empty()) continue;
+        size_t semicolon = entry.find(';');
+        double q = 1.0;
+        size_t qAt = semicolon == std::string::npos ? std::string::npos : entry.find("q=", semicolon);
+        if (qAt != std::string::npos) q = std::atof(entry.c_str() + qAt + 2);
+
+        if (type == "*/*") any = q;
+        else if (type == "application/*") applicationAny = q;
+        else {
+            WireFormat format = type == "application/json" ? WireFormat::Json : wireFormatFromContentType(type);
+            if (format == WireFormat::Json && type != "application/json") continue;
+            quality[static_cast<int>(format)] = q;
+            listedAt[static_cast<int>(format)] = index;
+        }
+        ++index;
+    }
+    // Formats not listed by name take the wildcard's q-value, if there is one
+    for (double& q : quality) {
+        if (q < 0) q = applicationAny >= 0 ? applicationAny : any;
+    }
+
+    WireFormat best = WireFormat::Json;
+    double bestQuality = quality[0];
+    size_t bestListedAt = SIZE_MAX;
+    for (WireFormat format : { WireFormat::MsgPack, WireFormat::Cbor }) {
+        int i = static_cast<int>(format);
+        if (quality[i] <= 0) continue;
+        // A binary type must beat JSON outright; between the two, the one listed first wins a tie
+        bool better = best == WireFormat::Json
+            ? quality[i] > bestQuality
+            : quality[i] > bestQuality || (quality[i] == bestQuality && listedAt[i] < bestListedAt);
+        if (better) {
+            best = format;
+            bestQuality = quality[i];
+            bestListedAt = listedAt[i];
+        }
+    }
+    return best;
+}
+
+// Function to serialize a document in a format
+inline std::string encodeWire(const nlohmann::json& document, WireFormat format) {
+    if (format == WireFormat::MsgPack || format == WireFormat::Cbor) {
+        std::vector<std::uint8_t> bytes = format == WireFormat::MsgPack
+            ? nlohmann::json::to_msgpack(document) : nlohmann::json::to_cbor(document);
+        return std::string(bytes.begin(), bytes.end());
+    }
+    return document.dump();
+}
+
+// Function to parse a document in a format, throws nlohmann::json::exception on bad input
+inline nlohmann::json decodeWire(const std::string& data, WireFormat format) {
+    if (format == WireFormat::MsgPack) return nlohmann::json::from_msgpack(data);
+    if (format == WireFormat::Cbor) return nlohmann::json::from_cbor(data);
+    return nlohmann::json::parse(data);
+}
+
+// Task list documents as the client reads them: GET /tasks, its pages and
+// its deltas. Any object with a "description" is taken as a task.
+struct TaskDocument {
+    std::vector<Task> tasks;
+    std::vector<int> deleted;
+    bool full = true;          // false for a delta
+    std::string nextCursor;    // empty on the last page
+};
+
+// SAX handler filling a TaskDocument straight from the parser's events.
+// Building a json DOM first costs several times more than the parse itself
+// for large task lists, so the client reads documents this way instead.
+class TaskDocumentReader : public nlohmann::json_sax<nlohmann::json> {
+public:
+    explicit TaskDocumentReader(TaskDocument& document) : document_(document) {}
+
+    bool null() override { return true; }
+    bool boolean(bool value) override {
+        if (frames_.size() == 1 && frames_.back().key == "full") document_.full = value;
+        return true;
+    }
+    bool number_integer(number_integer_t value) override { return number(static_cast<long long>(value)); }
+    bool number_unsigned(number_unsigned_t value) override { return number(static_cast<long long>(value)); }
+    bool number_float(number_float_t, const string_t&) override { return true; }
+    bool string(string_t& value) override {
+        if (frames_.empty()) return true;
+        Frame& frame = frames_.back();
+        if (frame.key == "description" && !frame.array) {
+            frame.task.description = std::move(value);
+            frame.isTask = true;
+        }
+        else if (frames_.size() == 1 && frame.key == "next_cursor") {
+            document_.nextCursor = std::move(value);
+        }
+        return true;
+    }
+    bool binary(binary_t&) override { return true; }
+    bool start_object(std::size_t) override {
+        frames_.push_back(Frame());
+        return true;
+    }
+    bool key(string_t& value) override {
+        frames_.back().key = std::move(value);
+        return true;
+    }
+    bool end_object() override {
+        if (frames_.back().isTask) document_.tasks.push_back(std::move(frames_.back().task));
+        frames_.pop_back();
+        return true;
+    }
+    bool start_array(std::size_t) override {
+        // Only the top-level "deleted" list holds anything we read
+        Frame frame;
+        frame.array = true;
+        frame.key = frames_.size() == 1 && frames_.back().key == "deleted" ? "deleted" : "";
+        frames_.push_back(std::move(frame));
+        return true;
+    }
+    bool end_array() override {
+        frames_.pop_back();
+        return true;
+    }
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& error) override {
+        throw error;
+    }
+
+private:
+    struct Frame {
+        std::string key;
+        Task task{ 0, "" };
+        bool isTask = false;
+        bool array = false;
+    };
+
+    bool number(long long value) {
+        if (frames_.empty()) return true;
+        Frame& frame = frames_.back();
+        if (frame.array && frame.key == "deleted") document_.deleted.push_back(static_cast<int>(value));
+        else if (!frame.array && frame.key == "id") frame.task.id = static_cast<int>(value);
+        return true;
+    }
+
+    TaskDocument& document_;
+    std::vector<Frame> frames_;
+};
+
+// Function to read a task list document in a format without building a DOM,
+// throws nlohmann::json::exception on bad input
+inline TaskDocument readTaskDocument(const std::string& data, WireFormat format) {
+    TaskDocument document;
+    TaskDocumentReader reader(document);
+    auto inputFormat = format == WireFormat::MsgPack ? nlohmann::json::input_format_t::msgpack
+        : format == WireFormat::Cbor ? nlohmann::json::input_format_t::cbor : nlohmann::json::input_format_t::json;
+    nlohmann::json::sax_parse(data, &reader, inputFormat);
+    return document;
+}
+
+#endif // WIRE_FORMAT_H
@@ -1,8 +1,10 @@
 ﻿#include "TaskUI.h"
-#include <iostream>
+#include "Log.h"
 
 // Entry point of the application
 int main() {
+    // Write log records from a background thread instead of the UI thread
+    logger.start(LogOptions());
     try {
         // Initialize the UI and necessary resources
         initializeUI();
@@ -15,9 +17,11 @@ int main() {
     }
     catch (const std::exception& e) {
         // Handle any exceptions and log the error
-        std::cerr << "Error: " << e.what() << std::endl;
+        LOG_ERROR("Task Manager stopped", { { "error", e.what() } });
+        logger.stop();
         return -1; // Return a non-zero value to indicate an error
     }
+    logger.stop();
 
     // Return 0 to indicate successful execution
     return 0;